@@ -0,0 +1,505 @@
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef __CONCURRENT_MAP_HPP__
+#define __CONCURRENT_MAP_HPP__
+
+#define CONCURRENT_SKIP_LIST_LVLS 32
+
+// nodes a thread may hold retired before it tries to move the epoch on
+#define EPOCH_RETIRE_THRESHOLD 64
+
+namespace cs540 {
+    /*
+     * Epoch based reclamation shared by every ConcurrentMap in the process.
+     * Threads pin the current global epoch for the length of an operation.
+     * Unlinked nodes are retired with the epoch current at the time, and
+     * are only freed once the global epoch is two past that. By then every
+     * thread that could have reached the node has unpinned.
+     */
+    class EpochDomain {
+        public:
+            // pins the calling thread for its lifetime; may be nested
+            class Guard {
+                public:
+                    Guard();
+                    ~Guard();
+                    Guard(const Guard &) = delete;
+                    Guard &operator=(const Guard &) = delete;
+            };
+
+            static EpochDomain &instance();
+
+            void retire(void *, void (*)(void *));
+
+            ~EpochDomain();
+
+        private:
+            struct Retired {
+                void *ptr;
+                void (*deleter)(void *);
+                uint64_t epoch;
+            };
+
+            // one per thread, recycled once a thread exits; retired nodes
+            // that are not yet safe to free stay behind for the next owner
+            struct ThreadRecord {
+                std::atomic<uint64_t> epoch{0};
+                std::atomic<bool> active{false};
+                std::atomic<bool> owned{false};
+                int depth = 0;
+                std::vector<Retired> limbo;
+                ThreadRecord *next = NULL;
+            };
+
+            struct ThreadHandle {
+                ThreadHandle();
+                ~ThreadHandle();
+                ThreadRecord *rec;
+            };
+
+            EpochDomain() = default;
+
+            static ThreadRecord *localRecord();
+            ThreadRecord *acquireRecord();
+            void enter(ThreadRecord *);
+            void exit(ThreadRecord *);
+            void tryAdvance();
+            void collect(ThreadRecord *);
+
+            std::atomic<uint64_t> globalEpoch{1};
+            std::atomic<ThreadRecord *> records{NULL};
+    };
+
+    /*
+     * Lock-free skip list in the style of Herlihy and Shavit. Forward links
+     * are atomic words whose low bit marks the node they belong to as
+     * deleted at that level. Erase marks a node's links from the top down,
+     * and the CAS that marks level 0 is the point at which the key leaves
+     * the map. Any traversal that meets a marked node snips it out.
+     *
+     * Values are immutable once inserted and are handed out by copy, since
+     * a reference could outlive the node.
+     */
+    template <typename _KeyT, typename _MapT>
+    class ConcurrentMap {
+        struct SkipNode;
+        public:
+            typedef std::pair<const _KeyT, _MapT> _ValT;
+
+            ConcurrentMap();
+            ConcurrentMap(const ConcurrentMap &) = delete;
+            ConcurrentMap &operator=(const ConcurrentMap &) = delete;
+            ~ConcurrentMap();
+
+            // size, exact only while no operation is in flight
+            size_t size() const;
+            bool empty() const;
+
+            // element access
+            bool contains(const _KeyT &) const;
+            bool find(const _KeyT &, _MapT &) const;
+            _MapT at(const _KeyT &) const;
+
+            // modifiers
+            bool insert(const _ValT &);
+            template<typename... _Args> bool emplace(const _KeyT &, _Args &&...);
+            bool erase(const _KeyT &);
+
+            // visits elements in key order; not a snapshot, elements
+            // inserted or erased during the walk may or may not be seen
+            template<typename _FuncT> void for_each(_FuncT) const;
+
+        private:
+            struct SkipNode {
+                _ValT *value() { return reinterpret_cast<_ValT *>(&storage); }
+                const _KeyT &key() { return value()->first; }
+
+                int height;
+                // the inserting and the erasing thread each drop one
+                // reference when done with the node; the last one retires it
+                std::atomic<int> refs;
+                typename std::aligned_storage<sizeof(_ValT), alignof(_ValT)>::type storage;
+                std::atomic<uintptr_t> next[1];
+            };
+
+            static bool isMarked(uintptr_t p) { return p & 1; }
+            static uintptr_t marked(uintptr_t p) { return p | 1; }
+            static SkipNode *pointer(uintptr_t p) { return reinterpret_cast<SkipNode *>(p & ~uintptr_t(1)); }
+            static uintptr_t word(SkipNode *n) { return reinterpret_cast<uintptr_t>(n); }
+
+            static SkipNode *allocNode(int height);
+            static void freeNode(void *);
+            static int randomLevel();
+
+            bool findPredecessors(const _KeyT &, SkipNode **, SkipNode **) const;
+            void release(SkipNode *);
+
+            SkipNode *head;
+            std::atomic<size_t> sz{0};
+    };
+
+    /*
+     * EPOCH_DOMAIN
+     */
+
+    inline EpochDomain &EpochDomain::instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    inline EpochDomain::~EpochDomain() {
+        ThreadRecord *rec = records.load();
+        while (rec) {
+            for (auto &r : rec->limbo) r.deleter(r.ptr);
+            ThreadRecord *temp = rec;
+            rec = rec->next;
+            delete temp;
+        }
+    }
+
+    inline EpochDomain::ThreadHandle::ThreadHandle() : rec(instance().acquireRecord()) {}
+
+    inline EpochDomain::ThreadHandle::~ThreadHandle() {
+        rec->owned.store(false);
+    }
+
+    inline EpochDomain::ThreadRecord *EpochDomain::localRecord() {
+        static thread_local ThreadHandle handle;
+        return handle.rec;
+    }
+
+    // reuses the record of an exited thread if there is one
+    inline EpochDomain::ThreadRecord *EpochDomain::acquireRecord() {
+        for (ThreadRecord *rec = records.load(); rec; rec = rec->next) {
+            bool expected = false;
+            if (!rec->owned.load() && rec->owned.compare_exchange_strong(expected, true)) return rec;
+        }
+
+        ThreadRecord *rec = new ThreadRecord;
+        rec->owned.store(true);
+        ThreadRecord *head = records.load();
+        do {
+            rec->next = head;
+        } while (!records.compare_exchange_weak(head, rec));
+        return rec;
+    }
+
+    inline void EpochDomain::enter(ThreadRecord *rec) {
+        if (rec->depth++) return;
+        rec->active.store(true);
+        rec->epoch.store(globalEpoch.load());
+    }
+
+    inline void EpochDomain::exit(ThreadRecord *rec) {
+        if (--rec->depth) return;
+        rec->active.store(false);
+    }
+
+    inline void EpochDomain::retire(void *p, void (*deleter)(void *)) {
+        ThreadRecord *rec = localRecord();
+        rec->limbo.push_back(Retired{p, deleter, globalEpoch.load()});
+        if (rec->limbo.size() >= EPOCH_RETIRE_THRESHOLD) {
+            tryAdvance();
+            collect(rec);
+        }
+    }
+
+    // the epoch moves on once every pinned thread has seen the current one
+    inline void EpochDomain::tryAdvance() {
+        uint64_t e = globalEpoch.load();
+        for (ThreadRecord *rec = records.load(); rec; rec = rec->next) {
+            if (rec->active.load() && rec->epoch.load() != e) return;
+        }
+        globalEpoch.compare_exchange_strong(e, e + 1);
+    }
+
+    // limbo is in retirement order, so the safe entries form a prefix
+    inline void EpochDomain::collect(ThreadRecord *rec) {
+        uint64_t e = globalEpoch.load();
+        size_t i = 0;
+        while (i < rec->limbo.size() && rec->limbo[i].epoch + 2 <= e) {
+            rec->limbo[i].deleter(rec->limbo[i].ptr);
+            i++;
+        }
+        rec->limbo.erase(rec->limbo.begin(), rec->limbo.begin() + i);
+    }
+
+    inline EpochDomain::Guard::Guard() {
+        instance().enter(localRecord());
+    }
+
+    inline EpochDomain::Guard::~Guard() {
+        instance().exit(localRecord());
+    }
+
+    /*
+     * CONCURRENT_MAP
+     */
+
+    template <typename _KeyT, typename _MapT>
+    ConcurrentMap<_KeyT, _MapT>::ConcurrentMap() {
+        head = allocNode(CONCURRENT_SKIP_LIST_LVLS);
+    }
+
+    // no other thread may be using the map; nodes already retired are
+    // left to the epoch domain
+    template <typename _KeyT, typename _MapT>
+    ConcurrentMap<_KeyT, _MapT>::~ConcurrentMap() {
+        SkipNode *curr = pointer(head->next[0].load());
+        while (curr) {
+            SkipNode *temp = curr;
+            curr = pointer(curr->next[0].load());
+            freeNode(temp);
+        }
+        ::operator delete(head);
+    }
+
+    template <typename _KeyT, typename _MapT>
+    size_t ConcurrentMap<_KeyT, _MapT>::size() const {
+        return sz.load();
+    }
+
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::empty() const {
+        return (sz.load()) ? false : true;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::contains(const _KeyT &k) const {
+        EpochDomain::Guard guard;
+        SkipNode *preds[CONCURRENT_SKIP_LIST_LVLS], *succs[CONCURRENT_SKIP_LIST_LVLS];
+        return findPredecessors(k, preds, succs);
+    }
+
+    /*
+     * Read-only descent that steps over marked nodes instead of snipping
+     * them, so lookups never write to shared memory. Linearizes at the
+     * read of the level 0 link that showed the node unmarked.
+     */
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::find(const _KeyT &k, _MapT &out) const {
+        EpochDomain::Guard guard;
+        SkipNode *pred = head, *curr = NULL;
+        for (int i = CONCURRENT_SKIP_LIST_LVLS - 1; i >= 0; i--) {
+            curr = pointer(pred->next[i].load());
+            while (curr) {
+                uintptr_t succ = curr->next[i].load();
+                while (isMarked(succ)) {
+                    curr = pointer(succ);
+                    if (!curr) break;
+                    succ = curr->next[i].load();
+                }
+                if (curr && curr->key() < k) {
+                    pred = curr;
+                    curr = pointer(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+
+        if (curr && curr->key() == k) {
+            out = curr->value()->second;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    _MapT ConcurrentMap<_KeyT, _MapT>::at(const _KeyT &k) const {
+        _MapT ret;
+        if (!find(k, ret)) {
+            throw std::out_of_range("ConcurrentMap<>::at : Could not find specified key in map.");
+        }
+        return ret;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::insert(const _ValT &elem) {
+        return emplace(elem.first, elem.second);
+    }
+
+    /*
+     * Links level 0 first, which is where the insert takes effect, then
+     * the upper levels one at a time. If an erase marks the node while it
+     * is still going up, the remaining levels are abandoned and the list
+     * is searched once more so anything linked after the eraser's own
+     * cleanup pass is snipped too.
+     */
+    template <typename _KeyT, typename _MapT>
+    template <typename... _Args>
+    bool ConcurrentMap<_KeyT, _MapT>::emplace(const _KeyT &k, _Args &&...args) {
+        EpochDomain::Guard guard;
+        SkipNode *preds[CONCURRENT_SKIP_LIST_LVLS], *succs[CONCURRENT_SKIP_LIST_LVLS];
+        if (findPredecessors(k, preds, succs)) return false;
+
+        int height = randomLevel();
+        SkipNode *node = allocNode(height);
+        try {
+            new (node->value()) _ValT(std::piecewise_construct,
+                    std::forward_as_tuple(k), std::forward_as_tuple(std::forward<_Args>(args)...));
+        } catch (...) {
+            ::operator delete(node);
+            throw;
+        }
+        node->refs.store(2);
+
+        while (true) {
+            for (int i = 0; i < height; i++) {
+                node->next[i].store(word(succs[i]));
+            }
+            uintptr_t expected = word(succs[0]);
+            if (preds[0]->next[0].compare_exchange_strong(expected, word(node))) break;
+            if (findPredecessors(k, preds, succs)) {
+                freeNode(node);
+                return false;
+            }
+        }
+        sz++;
+
+        for (int i = 1; i < height; i++) {
+            while (true) {
+                uintptr_t curr = node->next[i].load();
+                if (isMarked(curr)) goto done;
+                if (curr != word(succs[i]) && !node->next[i].compare_exchange_strong(curr, word(succs[i]))) continue;
+
+                uintptr_t expected = word(succs[i]);
+                if (preds[i]->next[i].compare_exchange_strong(expected, word(node))) break;
+                findPredecessors(k, preds, succs);
+                if (succs[0] != node) goto done;
+            }
+        }
+
+    done:
+        if (isMarked(node->next[0].load())) findPredecessors(k, preds, succs);
+        release(node);
+        return true;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::erase(const _KeyT &k) {
+        EpochDomain::Guard guard;
+        SkipNode *preds[CONCURRENT_SKIP_LIST_LVLS], *succs[CONCURRENT_SKIP_LIST_LVLS];
+        if (!findPredecessors(k, preds, succs)) return false;
+
+        SkipNode *victim = succs[0];
+        for (int i = victim->height - 1; i > 0; i--) {
+            uintptr_t succ = victim->next[i].load();
+            while (!isMarked(succ)) {
+                victim->next[i].compare_exchange_strong(succ, marked(succ));
+            }
+        }
+
+        uintptr_t succ = victim->next[0].load();
+        while (true) {
+            // somebody else got to level 0 first; the erase is theirs
+            if (isMarked(succ)) return false;
+            if (victim->next[0].compare_exchange_strong(succ, marked(succ))) break;
+        }
+        sz--;
+
+        findPredecessors(k, preds, succs);
+        release(victim);
+        return true;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    template <typename _FuncT>
+    void ConcurrentMap<_KeyT, _MapT>::for_each(_FuncT f) const {
+        EpochDomain::Guard guard;
+        SkipNode *curr = pointer(head->next[0].load());
+        while (curr) {
+            uintptr_t succ = curr->next[0].load();
+            if (!isMarked(succ)) f(*static_cast<const _ValT *>(curr->value()));
+            curr = pointer(succ);
+        }
+    }
+
+    /*
+     * PRIVATE HELPERS
+     */
+
+    template <typename _KeyT, typename _MapT>
+    typename ConcurrentMap<_KeyT, _MapT>::SkipNode *ConcurrentMap<_KeyT, _MapT>::allocNode(int height) {
+        size_t bytes = sizeof(SkipNode) + (height - 1) * sizeof(std::atomic<uintptr_t>);
+        SkipNode *node = static_cast<SkipNode *>(::operator new(bytes));
+        node->height = height;
+        new (&node->refs) std::atomic<int>(0);
+        for (int i = 0; i < height; i++) {
+            new (&node->next[i]) std::atomic<uintptr_t>(0);
+        }
+        return node;
+    }
+
+    // also the deleter handed to the epoch domain, so it must not need the map
+    template <typename _KeyT, typename _MapT>
+    void ConcurrentMap<_KeyT, _MapT>::freeNode(void *p) {
+        SkipNode *node = static_cast<SkipNode *>(p);
+        node->value()->~_ValT();
+        ::operator delete(node);
+    }
+
+    // per-thread generator; one word gives up to 64 coin flips
+    template <typename _KeyT, typename _MapT>
+    int ConcurrentMap<_KeyT, _MapT>::randomLevel() {
+        static thread_local std::mt19937_64 mt{std::random_device{}()};
+        uint64_t bits = mt();
+        int height = 1;
+        while (height < CONCURRENT_SKIP_LIST_LVLS && (bits & 1)) {
+            height++;
+            bits >>= 1;
+        }
+        return height;
+    }
+
+    /*
+     * Fills preds/succs with the nodes either side of k on every level,
+     * snipping out any marked node met on the way. A failed snip means the
+     * predecessor changed underneath, so the search restarts from head.
+     * Returns whether an unmarked node with key k is at level 0.
+     */
+    template <typename _KeyT, typename _MapT>
+    bool ConcurrentMap<_KeyT, _MapT>::findPredecessors(const _KeyT &k, SkipNode **preds, SkipNode **succs) const {
+    retry:
+        SkipNode *pred = head, *curr = NULL;
+        for (int i = CONCURRENT_SKIP_LIST_LVLS - 1; i >= 0; i--) {
+            curr = pointer(pred->next[i].load());
+            while (curr) {
+                uintptr_t succ = curr->next[i].load();
+                while (isMarked(succ)) {
+                    uintptr_t expected = word(curr);
+                    if (!pred->next[i].compare_exchange_strong(expected, word(pointer(succ)))) goto retry;
+                    curr = pointer(succ);
+                    if (!curr) break;
+                    succ = curr->next[i].load();
+                }
+                if (curr && curr->key() < k) {
+                    pred = curr;
+                    curr = pointer(succ);
+                } else {
+                    break;
+                }
+            }
+            preds[i] = pred;
+            succs[i] = curr;
+        }
+        return curr && curr->key() == k;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void ConcurrentMap<_KeyT, _MapT>::release(SkipNode *node) {
+        if (--node->refs == 0) {
+            EpochDomain::instance().retire(node, &ConcurrentMap::freeNode);
+        }
+    }
+}
+
+#endif
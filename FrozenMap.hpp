@@ -0,0 +1,406 @@
+#include <stdexcept>
+#include <functional>
+#include <initializer_list>
+#include <algorithm>
+#include <vector>
+#include <new>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "Map.hpp"
+
+#ifndef __FROZEN_MAP_HPP__
+#define __FROZEN_MAP_HPP__
+
+// alignment of the key array; the root and its first levels share a line
+#define FROZEN_MAP_ALIGN 64
+
+namespace cs540 {
+    /*
+     * Read only map for tables that are built once and then only searched.
+     * The keys live in one array in Eytzinger order: slot 1 is the root
+     * and the children of slot i are slots 2i and 2i + 1, so a search is
+     * a run of compares that pick the next index arithmetically, and the
+     * slots it can visit a few levels down are contiguous and are
+     * prefetched a cache line at a time. The values sit in a parallel
+     * array under the same indices, so a search only touches keys.
+     *
+     * Elements are not stored as pairs, so iterators yield a pair of
+     * references to the key and the value. Iteration follows the in order
+     * successor through the layout; index 0 is end().
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>>
+    class FrozenMap {
+        public:
+            class ConstIterator;
+            typedef ConstIterator Iterator;
+
+            typedef std::pair<const _KeyT, _MapT> _ValT;
+            typedef std::pair<const _KeyT &, const _MapT &> _RefT;
+
+            // constructors and assignment operator
+            FrozenMap();
+            FrozenMap(const FrozenMap &);
+            FrozenMap(FrozenMap &&);
+            FrozenMap &operator=(const FrozenMap &);
+            FrozenMap &operator=(FrozenMap &&);
+            FrozenMap(std::initializer_list<std::pair<const _KeyT, _MapT>>);
+            template<typename _AllocT, typename _LevelsT> explicit FrozenMap(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &);
+            template<typename _IterT> FrozenMap(_IterT, _IterT);
+            template<typename _IterT> FrozenMap(sorted_unique_t, _IterT, _IterT);
+            ~FrozenMap();
+
+            // size
+            size_t size() const;
+            bool empty() const;
+
+            // iterators
+            ConstIterator begin() const;
+            ConstIterator end() const;
+
+            // element access
+            ConstIterator find(const _KeyT &) const;
+            const _MapT &at(const _KeyT &) const;
+            size_t count(const _KeyT &) const;
+            bool contains(const _KeyT &) const;
+            ConstIterator lower_bound(const _KeyT &) const;
+            ConstIterator upper_bound(const _KeyT &) const;
+
+            void swap(FrozenMap &);
+
+            class ConstIterator {
+                public:
+                    // what operator-> points into, since there is no stored pair
+                    struct Arrow {
+                        _RefT ref;
+                        const _RefT *operator->() const { return &ref; }
+                    };
+
+                    ConstIterator() = delete;
+                    ConstIterator(const FrozenMap *m, size_t i) : map(m), idx(i) {}
+
+                    ConstIterator &operator++();
+                    ConstIterator &operator--();
+                    ConstIterator operator++(int);
+                    ConstIterator operator--(int);
+
+                    _RefT operator*() const { return _RefT(map->keys[idx], map->values[idx]); }
+                    Arrow operator->() const { return Arrow{**this}; }
+
+                    const FrozenMap *map;
+                    size_t idx;
+
+                    bool operator==(const ConstIterator &rhs) const { return idx == rhs.idx && map == rhs.map; }
+                    bool operator!=(const ConstIterator &rhs) const { return !(*this == rhs); }
+            };
+
+        private:
+            // layout navigation; every index past sz is absent and 0 is end
+            size_t first() const;
+            size_t last() const;
+            size_t successor(size_t) const;
+            size_t predecessor(size_t) const;
+            size_t lowerBound(const _KeyT &) const;
+            size_t upperBound(const _KeyT &) const;
+
+            // storage
+            void allocate(size_t);
+            void destroy(size_t);
+            template<typename _IterT> void build(_IterT, size_t);
+
+            _CompT comp;
+            _KeyT *keys = nullptr;
+            _MapT *values = nullptr;
+            size_t sz = 0;
+    };
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap() {}
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(const FrozenMap &m) : comp(m.comp) {
+        build(m.begin(), m.sz);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(FrozenMap &&m) : comp(m.comp) {
+        swap(m);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT> &FrozenMap<_KeyT, _MapT, _CompT>::operator=(const FrozenMap &m) {
+        if (this != &m) {
+            FrozenMap temp(m);
+            swap(temp);
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT> &FrozenMap<_KeyT, _MapT, _CompT>::operator=(FrozenMap &&m) {
+        if (this != &m) {
+            FrozenMap temp(std::move(m));
+            swap(temp);
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(std::initializer_list<std::pair<const _KeyT, _MapT>> il)
+        : FrozenMap(il.begin(), il.end()) {}
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    template <typename _AllocT, typename _LevelsT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &m) : comp(m.key_comp()) {
+        build(m.begin(), m.size());
+    }
+
+    // sorts a copy and keeps the first of equal keys, as inserting them
+    // one by one into a Map would
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    template <typename _IterT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(_IterT first, _IterT last) {
+        std::vector<std::pair<_KeyT, _MapT>> elems(first, last);
+        auto less = [this](const std::pair<_KeyT, _MapT> &a, const std::pair<_KeyT, _MapT> &b) { return comp(a.first, b.first); };
+        std::stable_sort(elems.begin(), elems.end(), less);
+        auto unique = [this](const std::pair<_KeyT, _MapT> &a, const std::pair<_KeyT, _MapT> &b) { return !comp(a.first, b.first); };
+        elems.erase(std::unique(elems.begin(), elems.end(), unique), elems.end());
+        build(elems.begin(), elems.size());
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    template <typename _IterT>
+    FrozenMap<_KeyT, _MapT, _CompT>::FrozenMap(sorted_unique_t, _IterT first, _IterT last) {
+        build(first, std::distance(first, last));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    FrozenMap<_KeyT, _MapT, _CompT>::~FrozenMap() {
+        destroy(sz);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::size() const {
+        return sz;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool FrozenMap<_KeyT, _MapT, _CompT>::empty() const {
+        return (sz) ? false : true;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::begin() const {
+        return ConstIterator(this, first());
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::end() const {
+        return ConstIterator(this, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::find(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        if (i && !comp(k, keys[i])) return ConstIterator(this, i);
+        return end();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    const _MapT &FrozenMap<_KeyT, _MapT, _CompT>::at(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        if (!i || comp(k, keys[i])) {
+            throw std::out_of_range("const FrozenMap<>::at : Could not find specified key in map.");
+        }
+        return values[i];
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::count(const _KeyT &k) const {
+        return contains(k) ? 1 : 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool FrozenMap<_KeyT, _MapT, _CompT>::contains(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        return i && !comp(k, keys[i]);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::lower_bound(const _KeyT &k) const {
+        return ConstIterator(this, lowerBound(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::upper_bound(const _KeyT &k) const {
+        return ConstIterator(this, upperBound(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void FrozenMap<_KeyT, _MapT, _CompT>::swap(FrozenMap &m) {
+        std::swap(comp, m.comp);
+        std::swap(keys, m.keys);
+        std::swap(values, m.values);
+        std::swap(sz, m.sz);
+    }
+
+    // the leftmost slot
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::first() const {
+        if (!sz) return 0;
+        size_t i = 1;
+        while (2 * i <= sz) i = 2 * i;
+        return i;
+    }
+
+    // the rightmost slot
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::last() const {
+        if (!sz) return 0;
+        size_t i = 1;
+        while (2 * i + 1 <= sz) i = 2 * i + 1;
+        return i;
+    }
+
+    // leftmost slot of the right subtree, or else up past every ancestor
+    // this slot is a right child of and one more
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::successor(size_t i) const {
+        if (2 * i + 1 <= sz) {
+            i = 2 * i + 1;
+            while (2 * i <= sz) i = 2 * i;
+            return i;
+        }
+        return i >> __builtin_ffsll(~(unsigned long long)i);
+    }
+
+    // the mirror image of successor(); end steps back to the last slot
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::predecessor(size_t i) const {
+        if (!i) return last();
+        if (2 * i <= sz) {
+            i = 2 * i;
+            while (2 * i + 1 <= sz) i = 2 * i + 1;
+            return i;
+        }
+        return i >> __builtin_ffsll((unsigned long long)i);
+    }
+
+    /*
+     * Each compare picks the child without a branch. The descent leaves
+     * the path in the bits of i, a 1 for every step right; the answer is
+     * the last slot the search went left at, which is i with its trailing
+     * ones and one more bit shifted off, or 0 when it never went left.
+     * The sixteen (for 4 byte keys) great great grandchildren of a slot
+     * are adjacent, so each step prefetches the line holding them.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::lowerBound(const _KeyT &k) const {
+        constexpr size_t perLine = (sizeof(_KeyT) < FROZEN_MAP_ALIGN) ? FROZEN_MAP_ALIGN / sizeof(_KeyT) : 1;
+        size_t i = 1;
+        while (i <= sz) {
+            __builtin_prefetch(keys + perLine * i);
+            i = 2 * i + comp(keys[i], k);
+        }
+        return i >> __builtin_ffsll(~(unsigned long long)i);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t FrozenMap<_KeyT, _MapT, _CompT>::upperBound(const _KeyT &k) const {
+        constexpr size_t perLine = (sizeof(_KeyT) < FROZEN_MAP_ALIGN) ? FROZEN_MAP_ALIGN / sizeof(_KeyT) : 1;
+        size_t i = 1;
+        while (i <= sz) {
+            __builtin_prefetch(keys + perLine * i);
+            i = 2 * i + !comp(k, keys[i]);
+        }
+        return i >> __builtin_ffsll(~(unsigned long long)i);
+    }
+
+    // slot 0 of either array is never constructed
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void FrozenMap<_KeyT, _MapT, _CompT>::allocate(size_t n) {
+        keys = static_cast<_KeyT *>(::operator new((n + 1) * sizeof(_KeyT), std::align_val_t(FROZEN_MAP_ALIGN)));
+        try {
+            values = std::allocator<_MapT>().allocate(n + 1);
+        } catch (...) {
+            ::operator delete(keys, std::align_val_t(FROZEN_MAP_ALIGN));
+            keys = nullptr;
+            throw;
+        }
+    }
+
+    // destroys the first n elements in order and releases the arrays
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void FrozenMap<_KeyT, _MapT, _CompT>::destroy(size_t n) {
+        if (!keys) return;
+        for (size_t i = first(); n; n--, i = successor(i)) {
+            keys[i].~_KeyT();
+            values[i].~_MapT();
+        }
+        ::operator delete(keys, std::align_val_t(FROZEN_MAP_ALIGN));
+        std::allocator<_MapT>().deallocate(values, sz + 1);
+        keys = nullptr;
+        values = nullptr;
+    }
+
+    // fills the slots in order from n sorted, unique elements
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    template <typename _IterT>
+    void FrozenMap<_KeyT, _MapT, _CompT>::build(_IterT it, size_t n) {
+        if (!n) return;
+        allocate(n);
+        sz = n;
+        size_t built = 0;
+        try {
+            for (size_t i = first(); built < n; ++it, i = successor(i)) {
+                new (keys + i) _KeyT(it->first);
+                try {
+                    new (values + i) _MapT(it->second);
+                } catch (...) {
+                    keys[i].~_KeyT();
+                    throw;
+                }
+                built++;
+            }
+        } catch (...) {
+            destroy(built);
+            sz = 0;
+            throw;
+        }
+    }
+
+    /*
+     * CONST_ITERATOR
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator &FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator::operator++() {
+        idx = map->successor(idx);
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator &FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator::operator--() {
+        idx = map->predecessor(idx);
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator::operator++(int) {
+        ConstIterator temp = *this;
+        ++*this;
+        return temp;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator FrozenMap<_KeyT, _MapT, _CompT>::ConstIterator::operator--(int) {
+        ConstIterator temp = *this;
+        --*this;
+        return temp;
+    }
+}
+
+#endif
@@ -0,0 +1,462 @@
+#include <stdexcept>
+#include <functional>
+#include <system_error>
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Map.hpp"
+
+#ifndef __LOGGED_MAP_HPP__
+#define __LOGGED_MAP_HPP__
+
+#define WAL_MAGIC "CS540WAL"
+#define WAL_VERSION 1
+
+// pending records are written out as one batch once they pass this size
+#define WAL_GROUP_BYTES (64 << 10)
+
+namespace cs540 {
+    /*
+     * When a write-ahead log forces its batches to disk: never (the OS
+     * writes them when it likes), once per batch, or after every change.
+     * Only always makes each change durable by the time it returns; under
+     * the others a batch is written once it fills or on commit().
+     */
+    enum class wal_sync { none, group, always };
+
+    /*
+     * Append only log of changes. Each change is one record: an opcode,
+     * the key and, for a put, the value, encoded by their SnapshotCodecs.
+     * A clear is the opcode alone.
+     * Records are gathered into a batch that goes to the file in a single
+     * write, framed by its length and checksum, and is then synced as the
+     * policy says. The file starts with a SnapshotHeader under its own
+     * magic. A batch cut short by a crash fails its checksum, and replay
+     * stops there.
+     */
+    template <typename _KeyT, typename _MapT>
+    class WriteAheadLog {
+        public:
+            enum : uint8_t { put_op = 1, erase_op = 2, clear_op = 3 };
+
+            struct Batch {
+                uint32_t bytes;
+                uint32_t records;
+                uint64_t checksum;
+            };
+
+            // the log is opened for appending after its last whole batch
+            WriteAheadLog(const std::string &, uint64_t, wal_sync);
+            WriteAheadLog(const WriteAheadLog &) = delete;
+            WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+            ~WriteAheadLog();
+
+            // a change that throws is not logged
+            void put(const _KeyT &, const _MapT &);
+            void erase(const _KeyT &);
+            void clear();
+
+            // writes the pending batch and, unless the policy is none, syncs
+            // it; on failure the file is cut back and the batch kept pending
+            void commit();
+
+            // drops every record
+            void truncate();
+
+            // applies each whole batch to f(op, key, value) and returns
+            // the length of the log they make up; 0 if there is no log.
+            // The key is a pointer, null for a clear
+            template<typename _FuncT> static uint64_t replay(const std::string &, _FuncT);
+
+            // replays into a map, returning the same length as replay()
+            template<typename _MapType> static uint64_t replayInto(_MapType &, const std::string &);
+
+            static uint64_t checksum(const char *, size_t);
+            static SnapshotHeader header();
+
+        private:
+            template<typename _FuncT> void add(uint8_t, _FuncT);
+            void writeAll(const char *, size_t);
+
+            std::string path;
+            int fd = -1;
+            wal_sync policy;
+            std::string pending;
+            uint32_t records = 0;
+    };
+
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>,
+              typename _AllocT = std::allocator<std::pair<const _KeyT, _MapT>>,
+              typename _LevelsT = PromoteHalf<>>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> recover(const std::string &);
+
+    /*
+     * Map whose changes are logged as they are made, so its contents
+     * survive a crash up to the last synced batch. Unless the policy is
+     * wal_sync::always, changes wait in memory until WAL_GROUP_BYTES of
+     * them build up, so a change is durable only once commit() returns;
+     * a crash loses any that were not committed. Opening a path recovers
+     * what it held. checkpoint() saves a snapshot next to the log and
+     * empties the log, which keeps recovery short.
+     *
+     * The map itself is read through map(); changes have to go through
+     * the members here to be logged, so a value cannot be assigned
+     * through operator[] and insert_or_assign() takes its place.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>,
+              typename _AllocT = std::allocator<std::pair<const _KeyT, _MapT>>,
+              typename _LevelsT = PromoteHalf<>>
+    class LoggedMap {
+        public:
+            typedef Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> _MapType;
+            typedef typename _MapType::_ValT _ValT;
+
+            // constructor
+            explicit LoggedMap(const std::string &, wal_sync = wal_sync::group);
+
+            // the map, read only
+            const _MapType &map() const;
+
+            // modifiers; each change is logged before it is made, so one
+            // that cannot be logged leaves the map as it was
+            std::pair<typename _MapType::Iterator, bool> insert(const _ValT &);
+            void insert_or_assign(const _KeyT &, const _MapT &);
+            void erase(const _KeyT &);
+            void clear();
+
+            // durability
+            void commit();
+            void checkpoint();
+
+        private:
+            _MapType contents;
+            std::unique_ptr<WriteAheadLog<_KeyT, _MapT>> log;
+            std::string path;
+    };
+
+    /*
+     * WRITE_AHEAD_LOG
+     */
+
+    template <typename _KeyT, typename _MapT>
+    WriteAheadLog<_KeyT, _MapT>::WriteAheadLog(const std::string &p, uint64_t validBytes, wal_sync s) : path(p), policy(s) {
+        // a new log is only durable once its directory entry is
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        bool created = (fd >= 0);
+        if (!created && errno == EEXIST) fd = ::open(path.c_str(), O_WRONLY);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+        try {
+            if (validBytes < sizeof(SnapshotHeader)) {
+                truncate();
+            } else if (::ftruncate(fd, validBytes) != 0 || ::lseek(fd, validBytes, SEEK_SET) < 0) {
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+            if (created) syncDirectory(path);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        pending.reserve(WAL_GROUP_BYTES + sizeof(Batch));
+    }
+
+    template <typename _KeyT, typename _MapT>
+    WriteAheadLog<_KeyT, _MapT>::~WriteAheadLog() {
+        try {
+            commit();
+        } catch (...) {
+        }
+        ::close(fd);
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::put(const _KeyT &k, const _MapT &v) {
+        add(put_op, [&]() {
+            SnapshotCodec<_KeyT>::append(pending, k);
+            SnapshotCodec<_MapT>::append(pending, v);
+        });
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::erase(const _KeyT &k) {
+        add(erase_op, [&]() { SnapshotCodec<_KeyT>::append(pending, k); });
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::clear() {
+        add(clear_op, []() {});
+    }
+
+    /*
+     * Appends a record and commits if the policy or the batch size says
+     * to. If either throws, the record is taken back out of the batch, so
+     * the caller can leave its change unmade and stay in step with the log.
+     */
+    template <typename _KeyT, typename _MapT>
+    template <typename _FuncT>
+    void WriteAheadLog<_KeyT, _MapT>::add(uint8_t op, _FuncT encode) {
+        size_t mark = pending.size();
+        try {
+            if (pending.empty()) pending.resize(sizeof(Batch));
+            pending.push_back(char(op));
+            encode();
+            records++;
+            try {
+                if (policy == wal_sync::always || pending.size() >= WAL_GROUP_BYTES) commit();
+            } catch (...) {
+                records--;
+                throw;
+            }
+        } catch (...) {
+            pending.resize(mark);
+            throw;
+        }
+    }
+
+    // the batch header takes the front of the pending buffer
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::commit() {
+        if (!records) return;
+        Batch batch;
+        batch.bytes = pending.size() - sizeof(Batch);
+        batch.records = records;
+        batch.checksum = checksum(pending.data() + sizeof(Batch), batch.bytes);
+        std::memcpy(&pending[0], &batch, sizeof(Batch));
+        off_t start = ::lseek(fd, 0, SEEK_CUR);
+        if (start < 0) throw std::system_error(errno, std::generic_category(), path);
+        try {
+            writeAll(pending.data(), pending.size());
+            if (policy != wal_sync::none && ::fdatasync(fd) != 0) {
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+        } catch (...) {
+            // a partial batch would stop replay short of any written after it
+            if (::ftruncate(fd, start) == 0) ::lseek(fd, start, SEEK_SET);
+            throw;
+        }
+        pending.clear();
+        records = 0;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::truncate() {
+        pending.clear();
+        records = 0;
+        SnapshotHeader h = header();
+        if (::ftruncate(fd, 0) != 0 || ::lseek(fd, 0, SEEK_SET) < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        writeAll(reinterpret_cast<const char *>(&h), sizeof(h));
+        if (::fsync(fd) != 0) throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    /*
+     * Stops at the end of the file or at the first batch that is cut off
+     * or fails its checksum; nothing after a torn batch can be trusted.
+     */
+    template <typename _KeyT, typename _MapT>
+    template <typename _FuncT>
+    uint64_t WriteAheadLog<_KeyT, _MapT>::replay(const std::string &path, _FuncT f) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0 || st.st_size == 0) return 0;
+        MappedFile file(path);
+        SnapshotHeader h = header();
+        if (file.bytes < sizeof(h) || std::memcmp(file.data, &h, sizeof(h)) != 0) {
+            throw std::runtime_error("Not a write-ahead log of these types: " + path);
+        }
+
+        const char *p = file.data + sizeof(h);
+        const char *end = file.data + file.bytes;
+        while (size_t(end - p) >= sizeof(Batch)) {
+            Batch batch;
+            std::memcpy(&batch, p, sizeof(Batch));
+            const char *records = p + sizeof(Batch);
+            if (size_t(end - records) < batch.bytes || checksum(records, batch.bytes) != batch.checksum) break;
+
+            const char *batchEnd = records + batch.bytes;
+            for (uint32_t i = 0; i < batch.records; i++) {
+                uint8_t op = SnapshotCodec<uint8_t>::read(records, batchEnd);
+                if (op == clear_op) {
+                    f(op, static_cast<const _KeyT *>(nullptr), _MapT());
+                    continue;
+                }
+                _KeyT k = SnapshotCodec<_KeyT>::read(records, batchEnd);
+                if (op == put_op) {
+                    f(op, &k, SnapshotCodec<_MapT>::read(records, batchEnd));
+                } else {
+                    f(op, &k, _MapT());
+                }
+            }
+            p = batchEnd;
+        }
+        return p - file.data;
+    }
+
+    /*
+     * Logs mostly grow in key order, so each put is hinted just past the
+     * last one, which makes an ascending run cost no searching at all.
+     */
+    template <typename _KeyT, typename _MapT>
+    template <typename _MapType>
+    uint64_t WriteAheadLog<_KeyT, _MapT>::replayInto(_MapType &m, const std::string &path) {
+        typename _MapType::Iterator hint = m.end();
+        return replay(path, [&](uint8_t op, const _KeyT *k, _MapT &&v) {
+            if (op == put_op) {
+                typename _MapType::Iterator it = m.insert(hint, typename _MapType::_ValT(*k, _MapT()));
+                it->second = std::move(v);
+                hint = ++it;
+            } else if (op == clear_op) {
+                m.clear();
+                hint = m.end();
+            } else {
+                typename _MapType::Iterator it = m.find(*k);
+                if (it != m.end()) {
+                    hint = it;
+                    ++hint;
+                    m.erase(it);
+                }
+            }
+        });
+    }
+
+    // FNV-1a, a word at a time
+    template <typename _KeyT, typename _MapT>
+    uint64_t WriteAheadLog<_KeyT, _MapT>::checksum(const char *p, size_t n) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            h = (h ^ w) * 0x100000001b3ULL;
+        }
+        for (; i < n; i++) {
+            h = (h ^ static_cast<unsigned char>(p[i])) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    SnapshotHeader WriteAheadLog<_KeyT, _MapT>::header() {
+        constexpr bool raw = SnapshotCodec<_KeyT>::raw && SnapshotCodec<_MapT>::raw;
+        SnapshotHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, WAL_MAGIC, sizeof(h.magic));
+        h.version = WAL_VERSION;
+        h.flags = raw ? SNAPSHOT_RAW : 0;
+        h.keyBytes = raw ? sizeof(_KeyT) : 0;
+        h.valueBytes = raw ? sizeof(_MapT) : 0;
+        return h;
+    }
+
+    template <typename _KeyT, typename _MapT>
+    void WriteAheadLog<_KeyT, _MapT>::writeAll(const char *p, size_t n) {
+        while (n) {
+            ssize_t done = ::write(fd, p, n);
+            if (done < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+            p += done;
+            n -= done;
+        }
+    }
+
+    /*
+     * RECOVER
+     */
+
+    // the snapshot, if there is one, and then the log on top of it
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> recover(const std::string &path) {
+        Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> m;
+        struct stat st;
+        if (::stat((path + ".snapshot").c_str(), &st) == 0) {
+            m.load(path + ".snapshot");
+        }
+        WriteAheadLog<_KeyT, _MapT>::replayInto(m, path);
+        return m;
+    }
+
+    /*
+     * LOGGED_MAP
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::LoggedMap(const std::string &p, wal_sync policy)
+        : path(p) {
+        struct stat st;
+        if (::stat((path + ".snapshot").c_str(), &st) == 0) {
+            contents.load(path + ".snapshot");
+        }
+        uint64_t valid = WriteAheadLog<_KeyT, _MapT>::replayInto(contents, path);
+        log.reset(new WriteAheadLog<_KeyT, _MapT>(path, valid, policy));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    const typename LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_MapType &LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::map() const {
+        return contents;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_MapType::Iterator, bool> LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(const _ValT &elem) {
+        auto it = contents.lower_bound(elem.first);
+        if (it != contents.end() && !contents.key_comp()(elem.first, it->first)) {
+            return std::make_pair(it, false);
+        }
+        log->put(elem.first, elem.second);
+        return std::make_pair(contents.insert(it, elem), true);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert_or_assign(const _KeyT &k, const _MapT &v) {
+        log->put(k, v);
+        auto result = contents.try_emplace(k, v);
+        if (!result.second) result.first->second = v;
+    }
+
+    // a missing key throws, as Map::erase does, and logs nothing
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase(const _KeyT &k) {
+        auto it = contents.find(k);
+        if (it == contents.end()) {
+            throw std::out_of_range("LoggedMap<>::erase : Could not find specified key in map.");
+        }
+        log->erase(k);
+        contents.erase(it);
+    }
+
+    // logged before the checkpoint, so the old log replays to empty too
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::clear() {
+        log->clear();
+        contents.clear();
+        checkpoint();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::commit() {
+        log->commit();
+    }
+
+    /*
+     * A crash after the snapshot is saved but before the log is emptied
+     * is harmless: replaying the old log over the snapshot sets each key
+     * it touches to its last logged state, which the snapshot already has,
+     * and a logged clear only drops keys the snapshot no longer holds.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void LoggedMap<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::checkpoint() {
+        log->commit();
+        contents.save(path + ".snapshot");
+        log->truncate();
+    }
+}
+
+#endif
@@ -0,0 +1,683 @@
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <system_error>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "Map.hpp"
+
+#ifndef __LSM_MAP_HPP__
+#define __LSM_MAP_HPP__
+
+// elements the memtable takes before it is frozen and flushed to a run
+#define LSM_MEMTABLE_ELEMENTS (1 << 20)
+
+// this many runs of about the same size are merged into one in the background
+#define LSM_TIER_RUNS 4
+
+// a run keeps every LSM_INDEX_INTERVAL-th key in its sparse index
+#define LSM_INDEX_INTERVAL 64
+
+#define LSM_RUN_MAGIC "CS540RUN"
+#define LSM_RUN_VERSION 1
+
+namespace cs540 {
+    /*
+     * Log structured key-value store in a directory, with a Map in front.
+     * Writes go to the memtable, a Map from keys to values or to erase
+     * markers. A full memtable is frozen and a background thread writes
+     * it out in order as an immutable sorted run file while a fresh one
+     * takes writes; if the frozen one is still being written, the next
+     * rotation waits for it; merges run on a thread of their own so they
+     * never hold a flush up. Lookups consult the memtable, the frozen
+     * memtable and then the runs from newest to oldest, and the first
+     * one that knows the key decides.
+     *
+     * A run is its records in key order (a live flag, the key and, if
+     * live, the value, each through its SnapshotCodec), then a sparse
+     * index holding every LSM_INDEX_INTERVAL-th key and its offset, then
+     * a footer. Runs are mapped, so a lookup binary searches the index
+     * in memory and decodes at most one interval of records.
+     *
+     * Runs are sorted into tiers by size, each LSM_TIER_RUNS times larger
+     * than the one below. Once LSM_TIER_RUNS neighbouring runs share a
+     * tier they are merged into one run of the next, keeping the newest
+     * value of each key, so an element is rewritten once per tier, a
+     * logarithmic number of times. Erase markers are dropped only when
+     * the oldest run is an input. The merged run takes the newest input's
+     * file name and records the oldest input it covers, so a crash
+     * halfway through removing the inputs is cleaned up on reopen.
+     *
+     * One thread uses a store at a time, as with Map. Elements in the
+     * memtable when the process dies are lost. Call flush() before the
+     * store is destroyed: it writes them out and throws if that fails.
+     * The destructor flushes whatever is left too, but can only report a
+     * failure on std::cerr.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>>
+    class LsmMap {
+        struct Run;
+        public:
+            typedef std::pair<const _KeyT, _MapT> _ValT;
+
+            // constructors
+            explicit LsmMap(const std::string &, size_t = LSM_MEMTABLE_ELEMENTS, const _CompT & = _CompT());
+            LsmMap(const LsmMap &) = delete;
+            LsmMap &operator=(const LsmMap &) = delete;
+            ~LsmMap();
+
+            // element access
+            bool find(const _KeyT &, _MapT &) const;
+            _MapT at(const _KeyT &) const;
+            bool contains(const _KeyT &) const;
+
+            // every live element in key order; f may read the store but
+            // not change it
+            template<typename _FuncT> void for_each(_FuncT) const;
+
+            // modifiers; erasing a key that is not there is not an error
+            void insert_or_assign(const _KeyT &, const _MapT &);
+            void erase(const _KeyT &);
+
+            // writes out the memtable, or merges every run, and waits for it
+            void flush();
+            void compact();
+
+            size_t run_count() const;
+
+        private:
+            typedef Map<_KeyT, std::optional<_MapT>, _CompT> _MemtableT;
+
+            // yields the next element of a sorted source, or false at its end
+            typedef std::function<bool(std::optional<_KeyT> &, std::optional<_MapT> &)> _SourceT;
+
+            struct RunFooter {
+                char magic[8];
+                uint32_t version;
+                uint32_t interval;
+                uint64_t count;
+                uint64_t indexOffset;
+                uint64_t indexEntries;
+                uint64_t firstSeq;
+            };
+
+            // one mapped run file and its sparse index
+            struct Run {
+                Run(const std::string &, uint64_t);
+
+                // true if the run holds k, live or erased
+                bool find(const _KeyT &, std::optional<_MapT> &, const _CompT &) const;
+                _SourceT source() const;
+                static void decode(const char *&, const char *, std::optional<_KeyT> &, std::optional<_MapT> &);
+
+                std::string path;
+                uint64_t seq;
+                uint64_t firstSeq;
+                uint64_t count;
+                MappedFile file;
+                const char *recordsEnd;
+                std::vector<std::pair<_KeyT, uint64_t>> index;
+            };
+
+            /*
+             * Merges sorted sources given newest first. Each key comes out
+             * once, with the newest source's value or erase marker; there
+             * are only a handful of sources, so the smallest head is found
+             * by scanning them.
+             */
+            struct Merge {
+                Merge(std::vector<_SourceT>, const _CompT &);
+                bool next(std::optional<_KeyT> &, std::optional<_MapT> &);
+
+                std::vector<_SourceT> all;
+                std::vector<std::optional<_KeyT>> keys;
+                std::vector<std::optional<_MapT>> values;
+                _CompT comp;
+            };
+
+            // helpers
+            void openRuns();
+            void rotate();
+            void flushWork();
+            void compactWork();
+            std::pair<size_t, size_t> tieredInputs() const;
+            void checkError() const;
+            bool findInRuns(const _KeyT &, std::optional<_MapT> &) const;
+            std::vector<_SourceT> sources() const;
+            std::shared_ptr<const Run> writeRun(uint64_t, uint64_t, _SourceT) const;
+            std::string runPath(uint64_t) const;
+
+            _CompT comp;
+            std::string dir;
+            size_t limit;
+            _MemtableT memtable;
+
+            // shared with the background thread
+            mutable std::mutex mutex;
+            std::condition_variable workReady;
+            mutable std::condition_variable workDone;
+            std::shared_ptr<const _MemtableT> frozen;
+            std::vector<std::shared_ptr<const Run>> runs;
+            uint64_t nextSeq = 1;
+            bool compactRequested = false;
+            bool stopping = false;
+            std::exception_ptr error;
+            std::thread flusher;
+            std::thread compactor;
+    };
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    LsmMap<_KeyT, _MapT, _CompT>::LsmMap(const std::string &path, size_t memtableLimit, const _CompT &c)
+        : comp(c), dir(path), limit(memtableLimit ? memtableLimit : 1), memtable(c) {
+        openRuns();
+        flusher = std::thread(&LsmMap::flushWork, this);
+        compactor = std::thread(&LsmMap::compactWork, this);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    LsmMap<_KeyT, _MapT, _CompT>::~LsmMap() {
+        try {
+            flush();
+        } catch (const std::exception &e) {
+            std::cerr << "LsmMap " << dir << ": final flush failed, elements lost: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "LsmMap " << dir << ": final flush failed, elements lost" << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workReady.notify_all();
+        flusher.join();
+        compactor.join();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool LsmMap<_KeyT, _MapT, _CompT>::find(const _KeyT &k, _MapT &v) const {
+        std::optional<_MapT> found;
+        auto it = memtable.find(k);
+        if (it != memtable.end()) {
+            found = it->second;
+        } else if (!findInRuns(k, found)) {
+            return false;
+        }
+        if (!found) return false;
+        v = *found;
+        return true;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    _MapT LsmMap<_KeyT, _MapT, _CompT>::at(const _KeyT &k) const {
+        std::optional<_MapT> found;
+        auto it = memtable.find(k);
+        if (it != memtable.end()) {
+            found = it->second;
+        } else {
+            findInRuns(k, found);
+        }
+        if (!found) {
+            throw std::out_of_range("const LsmMap<>::at : Could not find specified key in map.");
+        }
+        return *found;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool LsmMap<_KeyT, _MapT, _CompT>::contains(const _KeyT &k) const {
+        std::optional<_MapT> found;
+        auto it = memtable.find(k);
+        if (it != memtable.end()) return it->second.has_value();
+        findInRuns(k, found);
+        return found.has_value();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    template <typename _FuncT>
+    void LsmMap<_KeyT, _MapT, _CompT>::for_each(_FuncT f) const {
+        Merge merge(sources(), comp);
+        std::optional<_KeyT> k;
+        std::optional<_MapT> v;
+        while (merge.next(k, v)) {
+            if (v) f(_ValT(*k, *v));
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::insert_or_assign(const _KeyT &k, const _MapT &v) {
+        memtable[k] = v;
+        if (memtable.size() >= limit) rotate();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::erase(const _KeyT &k) {
+        memtable[k].reset();
+        if (memtable.size() >= limit) rotate();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::flush() {
+        if (!memtable.empty()) rotate();
+        std::unique_lock<std::mutex> lock(mutex);
+        workDone.wait(lock, [this]() { return !frozen || error; });
+        checkError();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::compact() {
+        flush();
+        std::unique_lock<std::mutex> lock(mutex);
+        compactRequested = true;
+        workReady.notify_all();
+        workDone.wait(lock, [this]() { return !compactRequested || error; });
+        checkError();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    size_t LsmMap<_KeyT, _MapT, _CompT>::run_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return runs.size();
+    }
+
+    /*
+     * Loads the runs already in the directory, oldest first. Leftover
+     * temporary files are unfinished runs, and a run inside the range a
+     * merged run covers was one of its inputs; both are removed.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::openRuns() {
+        std::filesystem::create_directories(dir);
+        std::vector<std::shared_ptr<const Run>> found;
+        for (auto &entry : std::filesystem::directory_iterator(dir)) {
+            const std::filesystem::path &p = entry.path();
+            if (p.extension() == ".tmp") {
+                std::filesystem::remove(p);
+            } else if (p.extension() == ".run") {
+                found.push_back(std::make_shared<const Run>(p.string(), std::stoull(p.stem().string())));
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const std::shared_ptr<const Run> &a, const std::shared_ptr<const Run> &b) {
+            return a->seq < b->seq;
+        });
+        for (auto &r : found) {
+            bool covered = false;
+            for (auto &m : found) {
+                covered |= (m->firstSeq <= r->seq && r->seq < m->seq);
+            }
+            if (covered) {
+                std::filesystem::remove(r->path);
+            } else {
+                runs.push_back(r);
+            }
+            nextSeq = std::max(nextSeq, r->seq + 1);
+        }
+    }
+
+    // hands the memtable to the background thread, once it has finished the last one
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::rotate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        workDone.wait(lock, [this]() { return !frozen || error; });
+        checkError();
+        frozen = std::make_shared<const _MemtableT>(std::move(memtable));
+        memtable.clear();
+        workReady.notify_all();
+    }
+
+    /*
+     * The background threads. File work happens without the lock; only
+     * publishing the result takes it. A failure is kept and rethrown to
+     * the next caller that waits on these threads, and stops the thread.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::flushWork() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            workReady.wait(lock, [this]() { return stopping || frozen; });
+            try {
+                if (frozen) {
+                    std::shared_ptr<const _MemtableT> table = frozen;
+                    uint64_t seq = nextSeq++;
+                    lock.unlock();
+                    auto it = table->begin();
+                    auto end = table->end();
+                    std::shared_ptr<const Run> run = writeRun(seq, seq, [it, end](std::optional<_KeyT> &k, std::optional<_MapT> &v) mutable {
+                        if (it == end) return false;
+                        k.emplace(it->first);
+                        v = it->second;
+                        ++it;
+                        return true;
+                    });
+                    lock.lock();
+                    runs.push_back(run);
+                    frozen.reset();
+                    workReady.notify_all();
+                } else {
+                    break;
+                }
+            } catch (...) {
+                if (!lock.owns_lock()) lock.lock();
+                error = std::current_exception();
+                workDone.notify_all();
+                break;
+            }
+            workDone.notify_all();
+        }
+    }
+
+    /*
+     * Merges a neighbouring span of runs, or every run when asked to.
+     * Only this thread removes runs and the flusher only appends them,
+     * so the inputs keep their positions while the merge is written. A
+     * request that arrives during a tiered merge is served by the next
+     * pass, so it is cleared only once a full merge is in.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::compactWork() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            workReady.wait(lock, [this]() {
+                return stopping || compactRequested || tieredInputs().second;
+            });
+            if (stopping) break;
+            bool full = compactRequested;
+            try {
+                std::pair<size_t, size_t> span = full ? std::make_pair(size_t(0), runs.size()) : tieredInputs();
+                if (span.second > 1 || (span.second == 1 && full)) {
+                    std::vector<std::shared_ptr<const Run>> inputs(runs.begin() + span.first, runs.begin() + span.first + span.second);
+                    // with the oldest run an input, erase markers have nothing left to hide
+                    bool dropErased = span.first == 0;
+                    lock.unlock();
+                    std::vector<_SourceT> all;
+                    for (auto r = inputs.rbegin(); r != inputs.rend(); ++r) {
+                        all.push_back((*r)->source());
+                    }
+                    Merge merge(std::move(all), comp);
+                    std::shared_ptr<const Run> run = writeRun(inputs.back()->seq, inputs.front()->firstSeq, [&merge, dropErased](std::optional<_KeyT> &k, std::optional<_MapT> &v) {
+                        while (merge.next(k, v)) {
+                            if (v || !dropErased) return true;
+                        }
+                        return false;
+                    });
+                    lock.lock();
+                    runs.erase(runs.begin() + span.first, runs.begin() + span.first + span.second);
+                    runs.insert(runs.begin() + span.first, run);
+                    // the merged run is durable, so the inputs can go; any
+                    // left behind are covered by it and removed on reopen
+                    for (size_t i = 0; i + 1 < inputs.size(); i++) {
+                        if (std::remove(inputs[i]->path.c_str()) != 0 && errno != ENOENT) {
+                            throw std::system_error(errno, std::generic_category(), inputs[i]->path);
+                        }
+                    }
+                }
+                if (full) compactRequested = false;
+            } catch (...) {
+                if (!lock.owns_lock()) lock.lock();
+                error = std::current_exception();
+                compactRequested = false;
+                workDone.notify_all();
+                break;
+            }
+            workDone.notify_all();
+        }
+    }
+
+    /*
+     * The first and count of the lowest tier's span of at least
+     * LSM_TIER_RUNS neighbouring runs, or a count of 0; a run of n
+     * elements is in tier log(n / limit) to the base LSM_TIER_RUNS.
+     * The caller holds the lock.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    std::pair<size_t, size_t> LsmMap<_KeyT, _MapT, _CompT>::tieredInputs() const {
+        auto tier = [this](const Run &r) {
+            size_t t = 0;
+            for (uint64_t n = r.count / limit; n >= LSM_TIER_RUNS; n /= LSM_TIER_RUNS) t++;
+            return t;
+        };
+        std::pair<size_t, size_t> best(0, 0);
+        size_t bestTier = 0;
+        for (size_t first = 0; first < runs.size();) {
+            size_t t = tier(*runs[first]);
+            size_t last = first + 1;
+            while (last < runs.size() && tier(*runs[last]) == t) last++;
+            if (last - first >= LSM_TIER_RUNS && (!best.second || t < bestTier)) {
+                best = std::make_pair(first, last - first);
+                bestTier = t;
+            }
+            first = last;
+        }
+        return best;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::checkError() const {
+        if (error) std::rethrow_exception(error);
+    }
+
+    // everything older than the memtable; the first that knows the key decides
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool LsmMap<_KeyT, _MapT, _CompT>::findInRuns(const _KeyT &k, std::optional<_MapT> &v) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frozen) {
+            auto it = frozen->find(k);
+            if (it != frozen->end()) {
+                v = it->second;
+                return true;
+            }
+        }
+        for (auto r = runs.rbegin(); r != runs.rend(); ++r) {
+            if ((*r)->find(k, v, comp)) return true;
+        }
+        return false;
+    }
+
+    /*
+     * Every source, newest first. The lock is held only to pick them: each
+     * keeps its frozen memtable or run alive, so they are read without it
+     * while the background threads carry on.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    std::vector<typename LsmMap<_KeyT, _MapT, _CompT>::_SourceT> LsmMap<_KeyT, _MapT, _CompT>::sources() const {
+        std::vector<_SourceT> all;
+        auto fromTable = [](const _MemtableT &t, std::shared_ptr<const _MemtableT> keep) {
+            auto it = t.begin();
+            auto end = t.end();
+            return _SourceT([it, end, keep](std::optional<_KeyT> &k, std::optional<_MapT> &v) mutable {
+                if (it == end) return false;
+                k.emplace(it->first);
+                v = it->second;
+                ++it;
+                return true;
+            });
+        };
+        all.push_back(fromTable(memtable, NULL));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frozen) all.push_back(fromTable(*frozen, frozen));
+        for (auto r = runs.rbegin(); r != runs.rend(); ++r) {
+            all.push_back([run = *r, next = (*r)->source()](std::optional<_KeyT> &k, std::optional<_MapT> &v) mutable {
+                return next(k, v);
+            });
+        }
+        return all;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    LsmMap<_KeyT, _MapT, _CompT>::Merge::Merge(std::vector<_SourceT> sources, const _CompT &c)
+        : all(std::move(sources)), keys(all.size()), values(all.size()), comp(c) {
+        for (size_t i = 0; i < all.size(); i++) {
+            if (!all[i](keys[i], values[i])) keys[i].reset();
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool LsmMap<_KeyT, _MapT, _CompT>::Merge::next(std::optional<_KeyT> &k, std::optional<_MapT> &v) {
+        size_t n = all.size();
+        size_t best = n;
+        for (size_t i = 0; i < n; i++) {
+            if (keys[i] && (best == n || comp(*keys[i], *keys[best]))) best = i;
+        }
+        if (best == n) return false;
+        k = std::move(keys[best]);
+        v = std::move(values[best]);
+        if (!all[best](keys[best], values[best])) keys[best].reset();
+        for (size_t i = best + 1; i < n; i++) {
+            if (keys[i] && !comp(*k, *keys[i]) && !all[i](keys[i], values[i])) keys[i].reset();
+        }
+        return true;
+    }
+
+    // written aside and renamed into place once it is on disk, and
+    // returned once the rename is too
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    std::shared_ptr<const typename LsmMap<_KeyT, _MapT, _CompT>::Run> LsmMap<_KeyT, _MapT, _CompT>::writeRun(uint64_t seq, uint64_t firstSeq, _SourceT next) const {
+        std::string path = runPath(seq);
+        std::string temp = path + ".tmp";
+        std::FILE *f = std::fopen(temp.c_str(), "wb");
+        if (!f) throw std::system_error(errno, std::generic_category(), temp);
+        std::setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+        std::vector<std::pair<_KeyT, uint64_t>> index;
+        std::optional<_KeyT> k;
+        std::optional<_MapT> v;
+        uint64_t count = 0;
+        while (next(k, v)) {
+            if (count % LSM_INDEX_INTERVAL == 0) index.emplace_back(*k, uint64_t(::ftello(f)));
+            SnapshotCodec<uint8_t>::write(f, v.has_value());
+            SnapshotCodec<_KeyT>::write(f, *k);
+            if (v) SnapshotCodec<_MapT>::write(f, *v);
+            count++;
+        }
+
+        RunFooter footer;
+        std::memcpy(footer.magic, LSM_RUN_MAGIC, sizeof(footer.magic));
+        footer.version = LSM_RUN_VERSION;
+        footer.interval = LSM_INDEX_INTERVAL;
+        footer.count = count;
+        footer.indexOffset = ::ftello(f);
+        footer.indexEntries = index.size();
+        footer.firstSeq = firstSeq;
+        for (auto &e : index) {
+            SnapshotCodec<_KeyT>::write(f, e.first);
+            SnapshotCodec<uint64_t>::write(f, e.second);
+        }
+        std::fwrite(&footer, sizeof(footer), 1, f);
+
+        bool failed = std::fflush(f) != 0 || ::fsync(::fileno(f)) != 0 || std::ferror(f);
+        int err = errno;
+        if (std::fclose(f) != 0 && !failed) {
+            failed = true;
+            err = errno;
+        }
+        if (!failed && std::rename(temp.c_str(), path.c_str()) != 0) {
+            failed = true;
+            err = errno;
+        }
+        if (failed) {
+            std::remove(temp.c_str());
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        syncDirectory(path);
+        return std::make_shared<const Run>(path, seq);
+    }
+
+    // zero padded, so the names sort by sequence number too
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    std::string LsmMap<_KeyT, _MapT, _CompT>::runPath(uint64_t seq) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu.run", (unsigned long long)seq);
+        return (std::filesystem::path(dir) / name).string();
+    }
+
+    /*
+     * RUN
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    LsmMap<_KeyT, _MapT, _CompT>::Run::Run(const std::string &p, uint64_t s) : path(p), seq(s), file(p) {
+        RunFooter footer;
+        if (file.bytes < sizeof(footer)) throw std::runtime_error("Not a run: " + path);
+        std::memcpy(&footer, file.data + file.bytes - sizeof(footer), sizeof(footer));
+        if (std::memcmp(footer.magic, LSM_RUN_MAGIC, sizeof(footer.magic)) != 0 || footer.version != LSM_RUN_VERSION ||
+            footer.interval != LSM_INDEX_INTERVAL || footer.indexOffset > file.bytes - sizeof(footer)) {
+            throw std::runtime_error("Not a run: " + path);
+        }
+        firstSeq = footer.firstSeq;
+        count = footer.count;
+        recordsEnd = file.data + footer.indexOffset;
+
+        const char *p2 = recordsEnd;
+        const char *end = file.data + file.bytes - sizeof(footer);
+        index.reserve(footer.indexEntries);
+        for (uint64_t i = 0; i < footer.indexEntries; i++) {
+            _KeyT k = SnapshotCodec<_KeyT>::read(p2, end);
+            uint64_t off = SnapshotCodec<uint64_t>::read(p2, end);
+            index.emplace_back(std::move(k), off);
+        }
+    }
+
+    // the last index entry not after k starts the only interval that can hold it
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    bool LsmMap<_KeyT, _MapT, _CompT>::Run::find(const _KeyT &k, std::optional<_MapT> &v, const _CompT &comp) const {
+        auto pos = std::upper_bound(index.begin(), index.end(), k, [&comp](const _KeyT &a, const std::pair<_KeyT, uint64_t> &b) {
+            return comp(a, b.first);
+        });
+        if (pos == index.begin()) return false;
+        --pos;
+        uint64_t first = uint64_t(pos - index.begin()) * LSM_INDEX_INTERVAL;
+        uint64_t left = std::min<uint64_t>(LSM_INDEX_INTERVAL, count - first);
+        const char *p = file.data + pos->second;
+        std::optional<_KeyT> key;
+        std::optional<_MapT> value;
+        while (left--) {
+            decode(p, recordsEnd, key, value);
+            if (!comp(*key, k)) {
+                if (comp(k, *key)) return false;
+                v = std::move(value);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    typename LsmMap<_KeyT, _MapT, _CompT>::_SourceT LsmMap<_KeyT, _MapT, _CompT>::Run::source() const {
+        const char *p = file.data;
+        const char *end = recordsEnd;
+        uint64_t left = count;
+        return [p, end, left](std::optional<_KeyT> &k, std::optional<_MapT> &v) mutable {
+            if (!left) return false;
+            left--;
+            decode(p, end, k, v);
+            return true;
+        };
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT>
+    void LsmMap<_KeyT, _MapT, _CompT>::Run::decode(const char *&p, const char *end, std::optional<_KeyT> &k, std::optional<_MapT> &v) {
+        uint8_t live = SnapshotCodec<uint8_t>::read(p, end);
+        k.emplace(SnapshotCodec<_KeyT>::read(p, end));
+        if (live) {
+            v.emplace(SnapshotCodec<_MapT>::read(p, end));
+        } else {
+            v.reset();
+        }
+    }
+}
+
+#endif
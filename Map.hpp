@@ -1,18 +1,473 @@
 #include <stdexcept>
 #include <random>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <vector>
 #include <iostream>
+#include <new>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <optional>
+#include <system_error>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifndef __MAP_HPP__
 #define __MAP_HPP__
 
 #define DEBUG 0
 
+// default cap on tower height, and so on the levels a search can start from
 #define SKIP_LIST_LVLS 32
 
+// elements a map holds in small mode, in an index that starts with room
+// for SMALL_MAP_FIRST and doubles as it fills
+#define SMALL_MAP_ELEMENTS 64
+#define SMALL_MAP_FIRST 8
+
+// number of searches find_many keeps in flight at once
+#define FIND_MANY_WIDTH 16
+
+// slabs start small and double up to the maximum as the pool grows
+#define SLAB_POOL_MIN_BYTES 256
+#define SLAB_POOL_MAX_BYTES (1 << 20)
+
+// snapshot file header; SNAPSHOT_RAW marks fixed size records
+#define SNAPSHOT_MAGIC "CS540MAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RAW 1u
+
 namespace cs540 {
+    /*
+     * Arena for fixed-size blocks. Memory is taken from the allocator in
+     * slabs and carved into blocks; freed blocks are kept on a free list
+     * per size class and handed out again before the slab is bumped.
+     * release() gives every slab back without visiting individual blocks.
+     * absorb() takes over another pool's slabs and free blocks, so blocks
+     * carved from it can be kept and freed here.
+     */
+    template <typename _AllocT, size_t _NumClasses>
+    class SlabPool {
+        public:
+            explicit SlabPool(const _AllocT &alloc = _AllocT());
+            SlabPool(const SlabPool &) = delete;
+            SlabPool &operator=(const SlabPool &) = delete;
+            ~SlabPool();
+
+            void *allocate(size_t sizeClass, size_t bytes);
+            void deallocate(void *, size_t sizeClass);
+            void release();
+            void absorb(SlabPool &);
+
+            void swap(SlabPool &) noexcept;
+            _AllocT get_allocator() const;
+
+        private:
+            typedef typename std::aligned_storage<sizeof(std::max_align_t), alignof(std::max_align_t)>::type _UnitT;
+            typedef typename std::allocator_traits<_AllocT>::template rebind_alloc<_UnitT> _UnitAllocT;
+
+            struct Slab {
+                Slab *next;
+                size_t units;
+            };
+            struct FreeBlock {
+                FreeBlock *next;
+            };
+
+            static size_t unitsFor(size_t bytes);
+
+            _UnitAllocT alloc;
+            FreeBlock *freeLists[_NumClasses] = {};
+            Slab *slabs = NULL;
+            _UnitT *cursor = NULL;
+            _UnitT *limit = NULL;
+            size_t nextSlabUnits;
+    };
+
+    // tag for constructors that may trust their input to be sorted and unique
+    struct sorted_unique_t {};
+    constexpr sorted_unique_t sorted_unique{};
+
+    /*
+     * Order preserving word-sized summary of a key, cached in each node so
+     * most comparisons on the way down never leave it. When it applies,
+     * make(a) < make(b) implies comp(a, b); equal prefixes decide nothing
+     * and the full keys are compared. accepts<_KT> says whether a probe of
+     * type _KT can be summarised the same way.
+     *
+     * Only byte-wise ordered strings have one: integral keys already sit
+     * in the node, and an arbitrary comparator gives nothing to go on.
+     */
+    template <typename _KeyT, typename _CompT>
+    struct KeyPrefix {
+        static constexpr bool enabled = false;
+        template <typename _KT> using accepts = std::false_type;
+    };
+
+    struct StringKeyPrefix {
+        static constexpr bool enabled = true;
+        template <typename _KT> using accepts = std::is_convertible<const _KT &, std::string_view>;
+
+        // first 8 bytes, big-endian, zero padded; char_traits<char>
+        // compares as unsigned char, so the word order matches
+        static uint64_t make(std::string_view s) {
+            uint64_t prefix = 0;
+            size_t n = (s.size() < 8) ? s.size() : 8;
+            for (size_t i = 0; i < n; i++) {
+                prefix |= uint64_t(static_cast<unsigned char>(s[i])) << (56 - 8 * i);
+            }
+            return prefix;
+        }
+    };
+
+    template <typename _StrAllocT>
+    struct KeyPrefix<std::basic_string<char, std::char_traits<char>, _StrAllocT>,
+                     std::less<std::basic_string<char, std::char_traits<char>, _StrAllocT>>> : StringKeyPrefix {};
+
+    template <typename _StrAllocT>
+    struct KeyPrefix<std::basic_string<char, std::char_traits<char>, _StrAllocT>, std::less<>> : StringKeyPrefix {};
+
+    // storage for the prefix, empty when there is none
+    template <bool _Enabled> struct KeyPrefixSlot {};
+    template <> struct KeyPrefixSlot<true> { uint64_t prefix; };
+
+    /*
+     * Tower height policies. max_height caps every tower and sizes the
+     * head. height() turns one random word into a height, each level
+     * being reached from the one below with the policy's probability.
+     * balanced() is the height a bulk load gives its rank-th element
+     * (from 1), thinning the levels out at the same rate without any
+     * randomness.
+     */
+    template <int _MaxHeight = SKIP_LIST_LVLS>
+    struct PromoteHalf {
+        static_assert(_MaxHeight > 0 && _MaxHeight <= 64, "a tower is drawn from one 64 bit word");
+        static constexpr int max_height = _MaxHeight;
+
+        // each trailing zero is one fair coin flip coming up heads
+        static int height(uint64_t word) {
+            int h = word ? 1 + __builtin_ctzll(word) : _MaxHeight;
+            return (h < _MaxHeight) ? h : _MaxHeight;
+        }
+        static int balanced(size_t rank) {
+            return height(rank);
+        }
+    };
+
+    // fewer links per node and longer runs per level than PromoteHalf
+    template <int _MaxHeight = SKIP_LIST_LVLS / 2>
+    struct PromoteQuarter {
+        static_assert(_MaxHeight > 0 && _MaxHeight <= 32, "a tower is drawn from one 64 bit word");
+        static constexpr int max_height = _MaxHeight;
+
+        // two trailing zeros per level
+        static int height(uint64_t word) {
+            int h = word ? 1 + __builtin_ctzll(word) / 2 : _MaxHeight;
+            return (h < _MaxHeight) ? h : _MaxHeight;
+        }
+        static int balanced(size_t rank) {
+            return height(rank);
+        }
+    };
+
+    // the probability that minimises the expected comparisons per search
+    template <int _MaxHeight = SKIP_LIST_LVLS>
+    struct PromoteInverseE {
+        static_assert(_MaxHeight > 0 && _MaxHeight <= 40, "e^-h must stay representable in a 64 bit word");
+        static constexpr int max_height = _MaxHeight;
+
+        // a tower reaches level h when word / 2^64 < e^-h
+        static int height(uint64_t word) {
+            int h = 1;
+            while (h < _MaxHeight && word < bounds.at[h]) h++;
+            return h;
+        }
+        // every 3^h-th element reaches level h, 1/3 standing in for 1/e
+        static int balanced(size_t rank) {
+            int h = 1;
+            while (h < _MaxHeight && rank % 3 == 0) {
+                rank /= 3;
+                h++;
+            }
+            return h;
+        }
+
+        private:
+            struct Bounds { uint64_t at[_MaxHeight]; };
+            static constexpr Bounds makeBounds() {
+                Bounds b{};
+                double p = 1;
+                for (int h = 1; h < _MaxHeight; h++) {
+                    p *= 0.36787944117144233;
+                    b.at[h] = static_cast<uint64_t>(p * 18446744073709551616.0);
+                }
+                return b;
+            }
+            static constexpr Bounds bounds = makeBounds();
+    };
+
+    /*
+     * Random words for tower heights: splitmix64, one add and two
+     * multiplies per word. random_device is opened once per process;
+     * after that each new source seeds itself from the next step of a
+     * shared counter, mixed like any other word.
+     */
+    class TowerRandom {
+        public:
+            TowerRandom() : state(freshSeed()) {}
+
+            // the same seed gives the same words
+            void seed(uint64_t s) { state = s; }
+
+            uint64_t next() {
+                return mix(state += 0x9e3779b97f4a7c15ULL);
+            }
+
+        private:
+            // the splitmix64 finalizer
+            static uint64_t mix(uint64_t z) {
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+            // unmixed, consecutive seeds would be one step of next() apart,
+            // and each source would replay its predecessor's stream
+            static uint64_t freshSeed() {
+                static std::atomic<uint64_t> counter{(uint64_t(std::random_device{}()) << 32) ^ std::random_device{}()};
+                return mix(counter.fetch_add(0x9e3779b97f4a7c15ULL, std::memory_order_relaxed));
+            }
+
+            uint64_t state;
+    };
+
+    /*
+     * Snapshot files. A header names the format and, for raw records, the
+     * key and value sizes, followed by the elements in key order. Numbers
+     * are in the writer's byte order. Each key and value is written by its
+     * SnapshotCodec: trivially copyable types as their bytes, which makes
+     * every record the same size, and strings as a length and the chars.
+     * Other types can be stored by specialising SnapshotCodec for them;
+     * a codec writes to a file, appends to a buffer and reads back.
+     */
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+        uint64_t count;
+    };
+
+    template <typename _T, typename = void>
+    struct SnapshotCodec;
+
+    template <typename _T>
+    struct SnapshotCodec<_T, typename std::enable_if<std::is_trivially_copyable<_T>::value>::type> {
+        static constexpr bool raw = true;
+
+        static void write(std::FILE *f, const _T &v) {
+            std::fwrite(&v, sizeof(_T), 1, f);
+        }
+        static void append(std::string &out, const _T &v) {
+            out.append(reinterpret_cast<const char *>(&v), sizeof(_T));
+        }
+        static _T read(const char *&p, const char *end) {
+            if (size_t(end - p) < sizeof(_T)) throw std::runtime_error("Truncated snapshot");
+            // the type need not be default constructible
+            typename std::aligned_storage<sizeof(_T), alignof(_T)>::type v;
+            std::memcpy(&v, p, sizeof(_T));
+            p += sizeof(_T);
+            return *reinterpret_cast<_T *>(&v);
+        }
+    };
+
+    template <typename _StrAllocT>
+    struct SnapshotCodec<std::basic_string<char, std::char_traits<char>, _StrAllocT>> {
+        typedef std::basic_string<char, std::char_traits<char>, _StrAllocT> _StrT;
+        static constexpr bool raw = false;
+
+        static void write(std::FILE *f, const _StrT &s) {
+            uint64_t n = s.size();
+            std::fwrite(&n, sizeof(n), 1, f);
+            std::fwrite(s.data(), 1, n, f);
+        }
+        static void append(std::string &out, const _StrT &s) {
+            SnapshotCodec<uint64_t>::append(out, s.size());
+            out.append(s.data(), s.size());
+        }
+        static _StrT read(const char *&p, const char *end) {
+            uint64_t n = SnapshotCodec<uint64_t>::read(p, end);
+            if (uint64_t(end - p) < n) throw std::runtime_error("Truncated snapshot");
+            _StrT s(p, n);
+            p += n;
+            return s;
+        }
+    };
+
+    // syncs the directory holding path, so that a file created or renamed
+    // there survives a power loss along with its contents
+    inline void syncDirectory(const std::string &path) {
+        size_t slash = path.rfind('/');
+        std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash ? slash : 1);
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0 || ::fsync(fd) != 0) {
+            int err = errno;
+            if (fd >= 0) ::close(fd);
+            throw std::system_error(err, std::generic_category(), dir);
+        }
+        ::close(fd);
+    }
+
+    // a whole file mapped read only, for one pass front to back
+    class MappedFile {
+        public:
+            explicit MappedFile(const std::string &path) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+                struct stat st;
+                if (::fstat(fd, &st) != 0) {
+                    int err = errno;
+                    ::close(fd);
+                    throw std::system_error(err, std::generic_category(), path);
+                }
+                bytes = st.st_size;
+                if (bytes) {
+                    void *addr = ::mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr == MAP_FAILED) {
+                        int err = errno;
+                        ::close(fd);
+                        throw std::system_error(err, std::generic_category(), path);
+                    }
+                    ::madvise(addr, bytes, MADV_SEQUENTIAL | MADV_WILLNEED);
+                    data = static_cast<const char *>(addr);
+                }
+                ::close(fd);
+            }
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+            ~MappedFile() {
+                if (data) ::munmap(const_cast<char *>(data), bytes);
+            }
+
+            const char *data = NULL;
+            size_t bytes = 0;
+    };
+
+    // decodes one record per step; each is read once, so it is moved out
     template <typename _KeyT, typename _MapT>
+    class SnapshotReader {
+        public:
+            SnapshotReader(const char *p, const char *e, uint64_t n) : pos(p), end(e), left(n) {
+                if (left) decode();
+            }
+
+            SnapshotReader &operator++() {
+                if (--left) decode();
+                return *this;
+            }
+            std::pair<_KeyT, _MapT> &&operator*() { return std::move(*elem); }
+
+            bool operator==(const SnapshotReader &rhs) const { return left == rhs.left; }
+            bool operator!=(const SnapshotReader &rhs) const { return left != rhs.left; }
+
+            const char *position() const { return pos; }
+
+        private:
+            void decode() {
+                _KeyT k = SnapshotCodec<_KeyT>::read(pos, end);
+                _MapT v = SnapshotCodec<_MapT>::read(pos, end);
+                elem.emplace(std::move(k), std::move(v));
+            }
+
+            const char *pos;
+            const char *end;
+            uint64_t left;
+            std::optional<std::pair<_KeyT, _MapT>> elem;
+    };
+
+    /*
+     * One step of a set operation on two sorted ranges per advance, so
+     * the result can be built from it without being gathered first.
+     * Where both ranges hold a key, the element is the first range's.
+     */
+    enum MergeKind { merge_union, merge_intersection, merge_difference };
+
+    template <typename _IterT, typename _ValT, typename _CompT>
+    class MergeReader {
+        public:
+            MergeReader(MergeKind k, _IterT a, _IterT aEnd, _IterT b, _IterT bEnd, const _CompT &c)
+                : kind(k), a(a), aEnd(aEnd), b(b), bEnd(bEnd), comp(c) {
+                settle();
+            }
+            // the end of any reader
+            MergeReader(_IterT aEnd, _IterT bEnd, const _CompT &c) : kind(merge_union), a(aEnd), aEnd(aEnd), b(bEnd), bEnd(bEnd), comp(c) {}
+
+            MergeReader &operator++() {
+                if (fromA) ++a;
+                if (fromB) ++b;
+                settle();
+                return *this;
+            }
+            MergeReader operator++(int) {
+                MergeReader ret(*this);
+                ++*this;
+                return ret;
+            }
+            const _ValT &operator*() const { return *elem; }
+
+            bool operator==(const MergeReader &rhs) const { return elem == rhs.elem; }
+            bool operator!=(const MergeReader &rhs) const { return elem != rhs.elem; }
+
+        private:
+            // moves to the next element of the result, skipping keys the
+            // operation drops, and notes which ranges it consumes
+            void settle() {
+                elem = NULL;
+                while (a != aEnd || b != bEnd) {
+                    bool haveA = a != aEnd, haveB = b != bEnd;
+                    fromA = haveA && (!haveB || !comp((*b).first, (*a).first));
+                    fromB = haveB && (!haveA || !comp((*a).first, (*b).first));
+                    if (kind == merge_union || (fromA && fromB && kind == merge_intersection) || (fromA && !fromB && kind == merge_difference)) {
+                        elem = fromA ? &*a : &*b;
+                        return;
+                    }
+                    if (!haveA || (kind != merge_union && !haveB)) {
+                        a = aEnd;
+                        b = bEnd;
+                        return;
+                    }
+                    if (fromA) ++a;
+                    if (fromB) ++b;
+                }
+            }
+
+            MergeKind kind;
+            _IterT a, aEnd, b, bEnd;
+            _CompT comp;
+            const _ValT *elem = NULL;
+            bool fromA = false;
+            bool fromB = false;
+    };
+
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>,
+              typename _AllocT = std::allocator<std::pair<const _KeyT, _MapT>>,
+              typename _LevelsT = PromoteHalf<>>
     class Map {
         struct SkipNode;
+        static constexpr int maxHeight = _LevelsT::max_height;
         public:
             class Iterator;
             class ConstIterator;
@@ -22,11 +477,23 @@ namespace cs540 {
 
             // constructors and assignment operator
             Map();
+            explicit Map(const _AllocT &);
+            explicit Map(const _CompT &, const _AllocT & = _AllocT());
             Map(const Map &);
+            Map(Map &&) noexcept;
             Map& operator=(const Map &);
+            Map& operator=(Map &&) noexcept;
             Map(std::initializer_list<std::pair<const _KeyT, _MapT>>);
+            template<typename _IterT> Map(_IterT, _IterT);
+            template<typename _IterT> Map(sorted_unique_t, _IterT, _IterT);
             ~Map();
 
+            _AllocT get_allocator() const;
+            _CompT key_comp() const;
+
+            // reseeds the tower heights of elements inserted from now on
+            void seed(uint64_t);
+
             // size
             size_t size() const;
             bool empty() const;
@@ -45,20 +512,84 @@ namespace cs540 {
             _MapT &at(const _KeyT &);
             const _MapT &at(const _KeyT &) const;
             _MapT &operator[](const _KeyT &);
+            _MapT &operator[](_KeyT &&);
+            size_t count(const _KeyT &) const;
+            bool contains(const _KeyT &) const;
+
+            // heterogeneous lookup, available when _CompT::is_transparent
+            // names a type; the probe is compared with keys as it is
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> Iterator find(const _KT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> ConstIterator find(const _KT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> _MapT &at(const _KT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> const _MapT &at(const _KT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> size_t count(const _KT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> bool contains(const _KT &) const;
+
+            // batch lookup, one iterator per key in the order given
+            template<typename _KeyIterT, typename _OutIterT> _OutIterT find_batch(_KeyIterT, _KeyIterT, _OutIterT);
+            template<typename _KeyIterT, typename _OutIterT> _OutIterT find_batch(_KeyIterT, _KeyIterT, _OutIterT) const;
+            template<typename _KeyIterT, typename _OutIterT> _OutIterT find_many(_KeyIterT, _KeyIterT, _OutIterT);
+            template<typename _KeyIterT, typename _OutIterT> _OutIterT find_many(_KeyIterT, _KeyIterT, _OutIterT) const;
+
+            // bounds
+            Iterator lower_bound(const _KeyT &);
+            ConstIterator lower_bound(const _KeyT &) const;
+            Iterator upper_bound(const _KeyT &);
+            ConstIterator upper_bound(const _KeyT &) const;
+            std::pair<Iterator, Iterator> equal_range(const _KeyT &);
+            std::pair<ConstIterator, ConstIterator> equal_range(const _KeyT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> Iterator lower_bound(const _KT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> ConstIterator lower_bound(const _KT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> Iterator upper_bound(const _KT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> ConstIterator upper_bound(const _KT &) const;
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> std::pair<Iterator, Iterator> equal_range(const _KT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent> std::pair<ConstIterator, ConstIterator> equal_range(const _KT &) const;
+
+            // positional access
+            Iterator nth(size_t);
+            ConstIterator nth(size_t) const;
+            size_t rank(const _KeyT &) const;
+            size_t count_range(const _KeyT &, const _KeyT &) const;
 
             // modifiers
             std::pair<Iterator, bool> insert(const _ValT &);
+            std::pair<Iterator, bool> insert(_ValT &&);
+            Iterator insert(Iterator, const _ValT &);
+            Iterator insert(Iterator, _ValT &&);
             template<typename _IterT> void insert(_IterT, _IterT);
+            template<typename _IterT> void assign_sorted(_IterT, _IterT);
+            template<typename... _Args> std::pair<Iterator, bool> emplace(_Args &&...);
+            template<typename... _Args> Iterator emplace_hint(Iterator, _Args &&...);
+            template<typename... _Args> std::pair<Iterator, bool> try_emplace(const _KeyT &, _Args &&...);
+            template<typename... _Args> std::pair<Iterator, bool> try_emplace(_KeyT &&, _Args &&...);
 
             void erase(Iterator);
             void erase(const _KeyT &);
+            template<typename _KT, typename _C = _CompT, typename = typename _C::is_transparent,
+                     typename = typename std::enable_if<!std::is_convertible<const _KT &, Iterator>::value>::type>
+            void erase(const _KT &);
+            Iterator erase(Iterator, Iterator);
+            size_t erase_range(const _KeyT &, const _KeyT &);
             void clear();
+            void swap(Map &) noexcept;
+
+            // moves over every element of m whose key is not here yet;
+            // the others stay in m
+            void merge(Map &);
+            void merge(Map &&);
 
             // comparison
             bool operator==(const Map &);
             bool operator!=(const Map &);
             bool operator<(const Map &);
 
+            // snapshots: save() writes the elements in key order to a
+            // file, load() replaces the contents with a saved file's. They
+            // are templates only so that the key and value types need a
+            // SnapshotCodec when they are called, not whenever the map is.
+            template<typename _KT = _KeyT, typename _VT = _MapT> void save(const std::string &) const;
+            template<typename _KT = _KeyT, typename _VT = _MapT> void load(const std::string &);
+
             // debug
             void debug();
 
@@ -115,340 +646,366 @@ namespace cs540 {
             };
 
         private:
-            struct SkipNode {
-                SkipNode(){};
-                SkipNode(std::pair<_KeyT, _MapT> p) {
-                    value = new _ValT(p);
-                }
-                SkipNode(const SkipNode &s) { value = new _ValT(*s.value); }
-                ~SkipNode() { if (value) delete value; }
-                SkipNode &operator=(const SkipNode &s) {
-                    if (value) delete value;
-                    value = new _ValT(*s.value);
-                    return *this;
-                }
-
-                _ValT *value = NULL;
-                bool end = false, begin = false;
-                SkipNode *prev = NULL,
-                         *next = NULL,
-                         *above = NULL,
-                         *below = NULL;
+            /*
+             * One allocation per element. The value lives inline and is
+             * followed by a forward link for every level the element
+             * reaches, so links[] is over-allocated to `height` entries.
+             * Only level 0 is doubly linked. Each link also records its
+             * width, the number of level 0 hops it spans, which is what
+             * makes positional lookups possible.
+             */
+            struct SkipLink {
+                SkipNode *next;
+                size_t width;
             };
 
-            // probability generator
-            std::random_device rd{};
-            std::mt19937 mt = std::mt19937(rd());
-            std::uniform_int_distribution<unsigned int> dist{0, 1};
+            typedef KeyPrefix<_KeyT, _CompT> _PrefixT;
+
+            struct SkipNode : KeyPrefixSlot<_PrefixT::enabled> {
+                _ValT *value() { return reinterpret_cast<_ValT *>(&storage); }
+                const _ValT *value() const { return reinterpret_cast<const _ValT *>(&storage); }
+
+                SkipNode *prev;
+                int height;
+                typename std::aligned_storage<sizeof(_ValT), alignof(_ValT)>::type storage;
+                SkipLink links[1];
+            };
 
-            // pointers
-            SkipNode *head = NULL;
-            SkipNode *bottomHead = NULL;
-            SkipNode *bottomTail = NULL;
+            // node allocation
+            static size_t nodeBytes(int height);
+            SkipNode *allocNode(int height);
+            void freeNode(SkipNode *);
+            template<typename... _Args> SkipNode *createNode(int height, _Args &&...);
+            void destroyNode(SkipNode *);
+            static void setPrefix(SkipNode *);
+            template<typename _KT> static uint64_t probePrefix(const _KT &);
+            template<typename _KT> bool nodeBefore(const SkipNode *, const _KT &, uint64_t) const;
+            template<typename _KT> bool nodeAfter(const SkipNode *, const _KT &, uint64_t) const;
+            void linkSentinels();
+            void adoptEnds();
+            bool atEnd(const SkipNode *) const;
+            SkipNode *levelEnd(int) const;
+
+            // small map mode
+            int linkedHeight(const SkipNode *) const;
+            bool growSmall();
+            void promoteSmall(SkipNode **, size_t *);
+            void demoteSmall();
+            void unorderSmall(size_t, size_t);
+            void releaseSmall();
+            template<typename _KT> SkipNode *findSmall(const _KT &, SkipNode **, size_t *) const;
+            template<typename _KT> SkipNode *findSmallUpper(const _KT &) const;
+
+            // helpers
+            void init();
+            void teardown();
+            void copyFrom(const SkipNode *, const Map &);
+            template<typename _IterT> _IterT appendSorted(_IterT, _IterT, bool);
+            void appendNode(SkipNode *, SkipNode **, size_t *);
+            void finishAppend(SkipNode **, size_t *);
+            void destroyAll(SkipNode *);
+            SkipNode *unlinkAll(SkipNode **, size_t *);
+            size_t countDuplicates(const Map &, size_t *) const;
+            void linkNode(SkipNode *);
+            void dropEmptyLevels();
+            void unlinkNode(SkipNode *, SkipNode **);
+            SkipNode *nthNode(size_t) const;
+            template<typename... _Args> std::pair<Iterator, bool> insertUnique(SkipNode *, const _KeyT &, _Args &&...);
+            std::pair<Iterator, bool> emplaceNode(SkipNode *, SkipNode *);
+            SkipNode *findInsertPath(SkipNode *, const _KeyT &);
+            SkipNode *moveFinger(const _KeyT &);
+            int randomLevel();
+            template<typename _KT> SkipNode *findNode(const _KT &) const;
+            template<typename _ItT, typename _KeyIterT, typename _OutIterT> _OutIterT findBatch(_KeyIterT, _KeyIterT, _OutIterT) const;
+            SkipNode *advancePath(SkipNode **, const _KeyT &) const;
+            template<typename _ItT, typename _KeyIterT, typename _OutIterT> _OutIterT findMany(_KeyIterT, _KeyIterT, _OutIterT) const;
+            template<typename _KT> SkipNode *findUpper(const _KT &) const;
+            void findNodePredecessors(SkipNode *, SkipNode **, size_t *) const;
+            template<typename _KT> SkipNode *findPredecessors(const _KT &, SkipNode **, size_t * = NULL) const;
+            bool valueEqual(const _ValT &, const _ValT &) const;
+            bool valueLess(const _ValT &, const _ValT &) const;
+
+            // key ordering
+            _CompT comp;
+
+            // source of tower heights
+            TowerRandom rng;
+
+            // element nodes, one size class per tower height
+            SlabPool<_AllocT, maxHeight> pool;
+
+            /*
+             * The sentinels live inside the map, so an empty one allocates
+             * nothing and end() stays put from construction on. Both carry
+             * an unused value slot, as they are laid out like any node.
+             */
+            typename std::aligned_storage<sizeof(SkipNode) + (maxHeight - 1) * sizeof(SkipLink), alignof(SkipNode)>::type headStorage;
+            typename std::aligned_storage<sizeof(SkipNode), alignof(SkipNode)>::type tailStorage;
+            SkipNode *const head = reinterpret_cast<SkipNode *>(&headStorage);
+            SkipNode *const tail = reinterpret_cast<SkipNode *>(&tailStorage);
             size_t sz = 0;
+
+            // head links in use: the tallest tower present, or 1 when
+            // empty. Searches start at the top one, and links above it
+            // hold nothing until a taller tower claims them. Level 0 ends
+            // at tail and the others at NULL, so that only the first and
+            // last elements know where the sentinels are.
+            int levels = 1;
+
+            /*
+             * Small map mode. While small, the elements are linked on level
+             * 0 only and listed in key order in smallOrder, which lookups
+             * binary search instead of walking; levels stays 1. Each node
+             * keeps the height it drew, and growing past SMALL_MAP_ELEMENTS
+             * builds the towers from them in one pass. The index starts at
+             * SMALL_MAP_FIRST entries and doubles as it fills, so it costs
+             * what the map holds, and erases bring small mode back at half
+             * its size, so the boundary does not rebuild towers each time.
+             * Nodes come from the pool either way and never move; the map
+             * holds only a pointer to the index, which a swap trades.
+             */
+            typedef typename std::allocator_traits<_AllocT>::template rebind_alloc<SkipNode *> _OrderAllocT;
+            SkipNode **smallOrder = NULL;
+            size_t smallCapacity = 0;
+            bool small = true;
+
+            // search path of the most recent insert, kept until the next
+            // erase so hinted inserts can start from it instead of head
+            SkipNode *finger[maxHeight];
+            size_t fingerRanks[maxHeight];
+            bool fingerValid = false;
     };
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::Map() {
-        head = new SkipNode();
-        head->begin = true;
+    // set operations: a single pass over both maps builds the result,
+    // which takes a's comparator and allocator, and a's element where
+    // both hold a key
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_union(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_intersection(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_difference(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &);
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map() : pool() {
+        init();
+    }
 
-        SkipNode *curr = head;
-        for (int i = 1; i < SKIP_LIST_LVLS; i++) {
-            SkipNode *temp = new SkipNode;
-            temp->begin = true;
-            curr->below = temp;
-            temp->above = curr;
-            curr = temp;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(const _AllocT &alloc) : pool(alloc) {
+        init();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(const _CompT &c, const _AllocT &alloc) : comp(c), pool(alloc) {
+        init();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(const Map &m)
+        : comp(m.comp), pool(std::allocator_traits<_AllocT>::select_on_container_copy_construction(m.get_allocator())) {
+        init();
+        try {
+            copyFrom(m.head->links[0].next, m);
+        } catch (...) {
+            teardown();
+            throw;
         }
-        bottomHead = curr;
+    }
 
-        SkipNode *sentinel = new SkipNode;
-        bottomTail = sentinel;
-        sentinel->end = true;
-        bottomHead->next = sentinel;
-        sentinel->prev = bottomHead;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(Map &&m) noexcept : comp(m.comp), pool(m.get_allocator()) {
+        init();
+        swap(m);
     }
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::Map(const Map &m) {
-        head = new SkipNode;
+    /*
+     * Reuses the nodes already here: each keeps its tower and takes a copy
+     * of the value at the same position in m, which leaves the links and
+     * widths of the overwritten prefix valid. Only the difference in size
+     * is then allocated or freed. If a copy throws, the map is left empty.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>& Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator=(const Map &m) {
+        if (this != &m) {
+            SkipNode *curr = head->links[0].next;
+            const SkipNode *mCurr = m.head->links[0].next;
+            fingerValid = false;
+            comp = m.comp;
+
+            // the prefix stays in order but the old suffix need not be
+            // greater than it, so its predecessors are tracked, not searched
+            SkipNode *rightMostNodes[maxHeight];
+            size_t rightMostRanks[maxHeight];
+            for (int i = 0; i < levels; i++) {
+                rightMostNodes[i] = head;
+                rightMostRanks[i] = 0;
+            }
 
-        SkipNode *rightMostNodes[SKIP_LIST_LVLS];
-        rightMostNodes[SKIP_LIST_LVLS-1] = head;
+            size_t rank = 0;
+            while (curr != tail && mCurr != m.tail) {
+                curr->value()->~_ValT();
+                try {
+                    new (curr->value()) _ValT(*mCurr->value());
+                    setPrefix(curr);
+                } catch (...) {
+                    destroyAll(curr);
+                    throw;
+                }
+                rank++;
+                for (int i = 0; i < curr->height; i++) {
+                    rightMostNodes[i] = curr;
+                    rightMostRanks[i] = rank;
+                }
+                curr = curr->links[0].next;
+                mCurr = mCurr->links[0].next;
+            }
 
-        SkipNode *curr = head;
-        for (int i = SKIP_LIST_LVLS-2; i >= 0; i--) {
-            SkipNode *temp = new SkipNode;
-            curr->below = temp;
-            temp->above = curr;
-            curr = temp;
-            rightMostNodes[i] = curr;
-        }
-        bottomHead = curr;
-        SkipNode *sentinel = new SkipNode;
-        bottomTail = sentinel;
-        sentinel->end = true;
-        bottomHead->next = sentinel;
-        sentinel->prev = bottomHead;
-        sz = m.sz;
-
-        if (m.sz) { // if any elements in the copy list
-            curr = m.bottomHead->next;
-            // traverse through bottom layer
-            while (curr && !curr->end) {
-                int currentLevel = 0;
-                SkipNode *copyNode = new SkipNode;
-                // deep copy
-                copyNode->end = curr->end;
-                copyNode->value = new _ValT(*(curr->value));
-
-                // link horizontally
-                copyNode->prev = rightMostNodes[currentLevel];
-                copyNode->next = rightMostNodes[currentLevel]->next;
-                rightMostNodes[currentLevel]->next = copyNode;
-
-                // set history
-                rightMostNodes[currentLevel] = copyNode;
-
-                // traverse vertically...
-                SkipNode * prevVert = copyNode;
-                SkipNode *vertCurr = curr->above;
-                while (vertCurr) {
-                    // keep track of what level
-                    currentLevel++;
-
-                    // deep copy
-                    SkipNode *vertCopyNode = new SkipNode;
-                    vertCopyNode->value = new _ValT(*(vertCurr->value));
-
-                    // link horizontally
-                    vertCopyNode->prev = rightMostNodes[currentLevel];
-                    rightMostNodes[currentLevel]->next = vertCopyNode;
-
-                    // link vertically
-                    prevVert->above = vertCopyNode;
-                    vertCopyNode->below = prevVert;
-
-                    // set history
-                    rightMostNodes[currentLevel] = vertCopyNode;
-
-                    // move up
-                    prevVert = vertCopyNode;
-                    vertCurr = vertCurr->above;
+            if (curr != tail) {
+                while (curr != tail) {
+                    SkipNode *temp = curr;
+                    curr = curr->links[0].next;
+                    destroyNode(temp);
+                }
+                for (int i = 0; i < levels; i++) {
+                    rightMostNodes[i]->links[i].next = levelEnd(i);
+                }
+                dropEmptyLevels();
+                tail->prev = rightMostNodes[0];
+                sz = rank;
+                finishAppend(rightMostNodes, rightMostRanks);
+                demoteSmall();
+            } else {
+                try {
+                    copyFrom(mCurr, m);
+                } catch (...) {
+                    clear();
+                    throw;
                 }
-                curr = curr->next;
             }
-            rightMostNodes[0]->next->prev = rightMostNodes[0];
         }
+        return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>& Map<_KeyT, _MapT>::operator=(const Map &m) {
+    // leaves m empty; the nodes and the allocator that owns them move here
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>& Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator=(Map &&m) noexcept {
         if (this != &m) {
             clear();
-
-            // history nodes
-            SkipNode *rightMostNodes[SKIP_LIST_LVLS];
-            // fill backwards to keep consistent with levels
-            rightMostNodes[SKIP_LIST_LVLS-1] = head;
-
-            SkipNode *curr = head;
-            for (int i = SKIP_LIST_LVLS-2; i >= 0; i--) {
-                curr = curr->below;
-                rightMostNodes[i] = curr;
-            }
-            bottomHead = curr;
-
-            sz = m.sz;
-            if (m.sz) {
-                curr = m.bottomHead->next;
-                while (curr && !curr->end) {
-                    int currentLevel = 0;
-                    SkipNode *copyNode = new SkipNode;
-                    // deep copy
-                    copyNode->end = curr->end;
-                    copyNode->value = new _ValT(*(curr->value));
-
-                    // link horizontally
-                    copyNode->prev = rightMostNodes[currentLevel];
-                    copyNode->next = rightMostNodes[currentLevel]->next;
-                    rightMostNodes[currentLevel]->next = copyNode;
-
-                    // set history
-                    rightMostNodes[currentLevel] = copyNode;
-
-                    // traverse vertically...
-                    SkipNode * prevVert = copyNode;
-                    SkipNode *vertCurr = curr->above;
-                    while (vertCurr) {
-                        // keep track of what level
-                        currentLevel++;
-
-                        SkipNode *vertCopyNode = new SkipNode;
-                        // deep copy
-                        vertCopyNode->value = new _ValT(*(vertCurr->value));
-
-                        // link horizontally
-                        vertCopyNode->prev = rightMostNodes[currentLevel];
-                        rightMostNodes[currentLevel]->next = vertCopyNode;
-
-                        // link vertically
-                        prevVert->above = vertCopyNode;
-                        vertCopyNode->below = prevVert;
-
-                        // set history
-                        rightMostNodes[currentLevel] = vertCopyNode;
-
-                        // move up
-                        prevVert = vertCopyNode;
-                        vertCurr = vertCurr->above;
-                    }
-                    curr = curr->next;
-                }
-                rightMostNodes[0]->next->prev = rightMostNodes[0];
-            }
+            swap(m);
         }
         return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::Map(std::initializer_list<std::pair<const _KeyT, _MapT>> il) {
-        head = new SkipNode();
-        head->begin = true;
-
-        SkipNode *curr = head;
-        for (int i = 1; i < SKIP_LIST_LVLS; i++) {
-            SkipNode *temp = new SkipNode;
-            temp->begin = true;
-            curr->below = temp;
-            temp->above = curr;
-            curr = temp;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(std::initializer_list<std::pair<const _KeyT, _MapT>> il) : pool() {
+        init();
+        try {
+            insert(il.begin(), il.end());
+        } catch (...) {
+            teardown();
+            throw;
         }
-        bottomHead = curr;
+    }
 
-        SkipNode *sentinel = new SkipNode;
-        bottomTail = sentinel;
-        sentinel->end = true;
-        bottomHead->next = sentinel;
-        sentinel->prev = bottomHead;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _IterT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(_IterT first, _IterT last) : pool() {
+        init();
+        try {
+            insert(first, last);
+        } catch (...) {
+            teardown();
+            throw;
+        }
+    }
 
-        for (auto &e : il) {
-            insert(e);
+    // the caller guarantees [first, last) is strictly increasing by key
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _IterT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Map(sorted_unique_t, _IterT first, _IterT last) : pool() {
+        init();
+        try {
+            appendSorted(first, last, false);
+        } catch (...) {
+            teardown();
+            throw;
         }
     }
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::~Map() {
-        SkipNode *currHeader = head;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::~Map() {
+        teardown();
+    }
 
-        while (currHeader) {
-            if (currHeader->next) {
-                SkipNode *curr = currHeader->next;
-                while (curr) {
-                    SkipNode *temp = curr;
-                    curr = curr->next;
-                    delete temp;
-                }
-            }
-            SkipNode *temp = currHeader;
-            currHeader = currHeader->below;
-            delete temp;
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    _AllocT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::get_allocator() const {
+        return pool.get_allocator();
     }
 
-    template <typename _KeyT, typename _MapT>
-    size_t Map<_KeyT, _MapT>::size() const {
-        return sz;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    _CompT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::key_comp() const {
+        return comp;
     }
 
-    template <typename _KeyT, typename _MapT>
-    bool Map<_KeyT, _MapT>::empty() const {
-        return (sz) ? false : true;
+    // the same seed and the same sequence of inserts give the same towers
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::seed(uint64_t s) {
+        rng.seed(s);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator Map<_KeyT, _MapT>::begin() {
-        return Iterator(bottomHead->next);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::size() const {
+        return sz;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator Map<_KeyT, _MapT>::end() {
-        return Iterator(bottomTail);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::empty() const {
+        return (sz) ? false : true;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ConstIterator Map<_KeyT, _MapT>::begin() const {
-        return ConstIterator(bottomHead->next);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::begin() {
+        return Iterator(head->links[0].next);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ConstIterator Map<_KeyT, _MapT>::end() const {
-        return ConstIterator(bottomTail);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::end() {
+        return Iterator(tail);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator Map<_KeyT, _MapT>::rbegin() {
-        return ReverseIterator(bottomTail->prev);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::begin() const {
+        return ConstIterator(head->links[0].next);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator Map<_KeyT, _MapT>::rend() {
-        return ReverseIterator(bottomHead);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::end() const {
+        return ConstIterator(tail);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator Map<_KeyT, _MapT>::find(const _KeyT &k) {
-        SkipNode *curr = head;
-        while (!(curr->end)) {
-            if (!(curr->begin) && !(curr->end) && curr->value->first == k) break;
-
-            if (curr->next) {
-                if (!curr->next->end && (curr->next->value->first < k || curr->next->value->first == k)) {
-                    curr = curr->next;
-                } else if (curr->below) {
-                    curr = curr->below;
-                } else {
-                    return end();
-                }
-            } else if (curr->below) {
-                curr = curr->below;
-            } else {
-                return end();
-            }
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::rbegin() {
+        return ReverseIterator(tail->prev);
+    }
 
-        while (curr->below) curr = curr->below;
-        return Iterator(curr);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::rend() {
+        return ReverseIterator(head);
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ConstIterator Map<_KeyT, _MapT>::find(const _KeyT &k) const {
-        SkipNode *curr = head;
-        while (!(curr->end)) {
-            if (!(curr->begin) && !(curr->end) && curr->value->first == k) break;
-
-            if (curr->next) {
-                if (curr->next->value->first < k || curr->next->value->first == k) {
-                    curr = curr->next;
-                } else if (curr->below) {
-                    curr = curr->below;
-                } else {
-                    return end();
-                }
-            } else if (curr->below) {
-                curr = curr->below;
-            } else {
-                return end();
-            }
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find(const _KeyT &k) {
+        return Iterator(findNode(k));
+    }
 
-        while (curr->below) curr = curr->below;
-        return ConstIterator(curr);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find(const _KeyT &k) const {
+        return ConstIterator(findNode(k));
     }
 
-    template <typename _KeyT, typename _MapT>
-    _MapT &Map<_KeyT, _MapT>::at(const _KeyT &k) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::at(const _KeyT &k) {
         Iterator search = find(k);
         if (search != end()) {
             return search->second;
@@ -457,8 +1014,8 @@ namespace cs540 {
         }
     }
 
-    template <typename _KeyT, typename _MapT>
-    const _MapT &Map<_KeyT, _MapT>::at(const _KeyT &k) const {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    const _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::at(const _KeyT &k) const {
         ConstIterator search = find(k);
         if (search != end()) {
             return search->second;
@@ -467,159 +1024,581 @@ namespace cs540 {
         }
     }
 
-    template <typename _KeyT, typename _MapT>
-    _MapT &Map<_KeyT, _MapT>::operator[](const _KeyT &k) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::count(const _KeyT &k) const {
+        return (findNode(k) != tail) ? 1 : 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::contains(const _KeyT &k) const {
+        return findNode(k) != tail;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find(const _KT &k) {
+        return Iterator(findNode(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find(const _KT &k) const {
+        return ConstIterator(findNode(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::at(const _KT &k) {
         Iterator search = find(k);
         if (search != end()) {
             return search->second;
         } else {
-            auto ret = insert({k, _MapT{}});
-            return ret.first->second;
+            throw std::out_of_range("Map<>::at : Could not find specified key in map.");
         }
     }
 
-    template <typename _KeyT, typename _MapT>
-    std::pair<typename Map<_KeyT, _MapT>::Iterator, bool> Map<_KeyT, _MapT>::insert(const _ValT &elem) {
-        int currLevel = 31;
-        SkipNode *history[SKIP_LIST_LVLS];
-        SkipNode *curr = head;
-        while (curr) {
-            if (!(curr->end) && !(curr->begin) && curr->value->first == elem.first) {
-                while (curr->below) curr = curr->below;
-                return std::pair<Iterator, bool>{Iterator(curr), false};
-            }
-
-            if (!(curr->next)) {
-                history[currLevel--] = curr;
-                curr = curr->below;
-            } else if (!curr->next->end && (curr->next->value->first < elem.first || curr->next->value->first == elem.first)) {
-                curr = curr->next;
-            } else {
-                history[currLevel--] = curr;
-                curr = curr->below;
-            }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    const _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::at(const _KT &k) const {
+        ConstIterator search = find(k);
+        if (search != end()) {
+            return search->second;
+        } else {
+            throw std::out_of_range("const Map<>::at : Could not find specified key in map.");
         }
+    }
 
-        SkipNode *insertNode = new SkipNode(elem);
-        auto ret = std::pair<Iterator, bool>{Iterator(insertNode), true};
-        insertNode->next = history[0]->next;
-        insertNode->prev = history[0];
-        if (insertNode->next) insertNode->next->prev = insertNode;
-        history[0]->next = insertNode;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::count(const _KT &k) const {
+        return (findNode(k) != tail) ? 1 : 0;
+    }
 
-        int coinFlip, insertLevel = 0;
-        while ((coinFlip = dist(mt))) {
-            insertLevel++;
-            if (insertLevel > (SKIP_LIST_LVLS-1)) break;
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::contains(const _KT &k) const {
+        return findNode(k) != tail;
+    }
 
-        SkipNode *previousInsert = insertNode;
-        for (int i = 1; i <= insertLevel; i++) {
-            insertNode = new SkipNode(elem);
-            insertNode->next = history[i]->next;
-            insertNode->prev = history[i];
-            if (insertNode->next) insertNode->next->prev = insertNode;
-            history[i]->next = insertNode;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator[](const _KeyT &k) {
+        return try_emplace(k).first->second;
+    }
 
-            previousInsert->above = insertNode;
-            insertNode->below = previousInsert;
-            previousInsert = insertNode;
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    _MapT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator[](_KeyT &&k) {
+        return try_emplace(std::move(k)).first->second;
+    }
 
-        sz++;
-        return ret;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::lower_bound(const _KeyT &k) {
+        return Iterator(findPredecessors(k, NULL));
     }
 
-    template <typename _KeyT, typename _MapT>
-    template <typename _IterT>
-    void Map<_KeyT, _MapT>::insert(_IterT begin, _IterT end) {
-        for (; begin != end; begin++) {
-            insert(*begin);
-        }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::lower_bound(const _KeyT &k) const {
+        return ConstIterator(findPredecessors(k, NULL));
     }
 
-    template <typename _KeyT, typename _MapT>
-    void Map<_KeyT, _MapT>::erase(Iterator pos) {
-        SkipNode *curr = pos.ref;
-        while (curr) {
-            curr->prev->next = curr->next;
-            if (curr->next) curr->next->prev = curr->prev;
-            SkipNode *temp = curr;
-            curr = curr->above;
-            delete temp;
-        }
-        sz--;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::upper_bound(const _KeyT &k) {
+        return Iterator(findUpper(k));
     }
 
-    template <typename _KeyT, typename _MapT>
-    void Map<_KeyT, _MapT>::erase(const _KeyT &k) {
-        SkipNode *curr = head;
-        while (!curr->end) {
-            if (!(curr->begin) && !(curr->end) && curr->value->first == k) {
-                while (curr) {
-                    SkipNode *temp = curr->below;
-                    curr->prev->next = curr->next;
-                    if (curr->next) curr->next->prev = curr->prev;
-                    delete curr;
-                    curr = temp;
-                }
-                sz--;
-                return;
-            }
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::upper_bound(const _KeyT &k) const {
+        return ConstIterator(findUpper(k));
+    }
 
-            if (curr->next) {
-                if (!curr->next->end && (curr->next->value->first < k || curr->next->value->first == k)) {
-                    curr = curr->next;
-                } else if (curr->below) {
-                    curr = curr->below;
-                } else {
-                    throw std::out_of_range("Map<>::erase : Could not find specified key in map.");
-                }
-            } else if (curr->below) {
-                curr = curr->below;
-            } else {
-                throw std::out_of_range("Map<>::erase : Could not find specified key in map.");
-            }
-        }
+    // keys are unique, so the range is empty or the one node at lower_bound
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::equal_range(const _KeyT &k) {
+        SkipNode *lower = findPredecessors(k, NULL);
+        SkipNode *upper = (lower != tail && !comp(k, lower->value()->first)) ? lower->links[0].next : lower;
+        return std::pair<Iterator, Iterator>{Iterator(lower), Iterator(upper)};
+    }
 
-        throw std::out_of_range("Map<>::erase : Could not find specified key in map.");
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator, typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::equal_range(const _KeyT &k) const {
+        SkipNode *lower = findPredecessors(k, NULL);
+        SkipNode *upper = (lower != tail && !comp(k, lower->value()->first)) ? lower->links[0].next : lower;
+        return std::pair<ConstIterator, ConstIterator>{ConstIterator(lower), ConstIterator(upper)};
     }
 
-    template <typename _KeyT, typename _MapT>
-        void Map<_KeyT, _MapT>::clear() {
-            SkipNode *curr = bottomHead->next;
-            while (curr && !curr->end) {
-                SkipNode * temp;
-                SkipNode * vertCurr = curr->above;
-                while (vertCurr) {
-                    temp = vertCurr;
-                    vertCurr = vertCurr->above;
-                    delete temp;
-                }
-                temp = curr;
-                curr = curr->next; sz--;
-                delete temp;
-            }
-            SkipNode *tempSent = curr;
-            // reset rowHeader->next pointers
-            curr = head; 
-            while (curr) {
-                curr->next = NULL;
-                curr = curr->below;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::lower_bound(const _KT &k) {
+        return Iterator(findPredecessors(k, NULL));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::lower_bound(const _KT &k) const {
+        return ConstIterator(findPredecessors(k, NULL));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::upper_bound(const _KT &k) {
+        return Iterator(findUpper(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::upper_bound(const _KT &k) const {
+        return ConstIterator(findUpper(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::equal_range(const _KT &k) {
+        SkipNode *lower = findPredecessors(k, NULL);
+        SkipNode *upper = (lower != tail && !comp(k, lower->value()->first)) ? lower->links[0].next : lower;
+        return std::pair<Iterator, Iterator>{Iterator(lower), Iterator(upper)};
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator, typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::equal_range(const _KT &k) const {
+        SkipNode *lower = findPredecessors(k, NULL);
+        SkipNode *upper = (lower != tail && !comp(k, lower->value()->first)) ? lower->links[0].next : lower;
+        return std::pair<ConstIterator, ConstIterator>{ConstIterator(lower), ConstIterator(upper)};
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nth(size_t i) {
+        return Iterator(nthNode(i));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nth(size_t i) const {
+        return ConstIterator(nthNode(i));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find_batch(_KeyIterT first, _KeyIterT last, _OutIterT out) {
+        return findBatch<Iterator>(first, last, out);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find_batch(_KeyIterT first, _KeyIterT last, _OutIterT out) const {
+        return findBatch<ConstIterator>(first, last, out);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find_many(_KeyIterT first, _KeyIterT last, _OutIterT out) {
+        return findMany<Iterator>(first, last, out);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::find_many(_KeyIterT first, _KeyIterT last, _OutIterT out) const {
+        return findMany<ConstIterator>(first, last, out);
+    }
+
+    // number of elements with keys less than k
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::rank(const _KeyT &k) const {
+        size_t ranks[maxHeight] = {};
+        findPredecessors(k, NULL, ranks);
+        return ranks[0];
+    }
+
+    // number of elements with keys in [lo, hi)
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::count_range(const _KeyT &lo, const _KeyT &hi) const {
+        if (!comp(lo, hi)) return 0;
+        return rank(hi) - rank(lo);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(const _ValT &elem) {
+        return insertUnique(NULL, elem.first, elem);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(_ValT &&elem) {
+        return insertUnique(NULL, elem.first, std::move(elem));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(Iterator hint, const _ValT &elem) {
+        return insertUnique(hint.ref, elem.first, elem).first;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(Iterator hint, _ValT &&elem) {
+        return insertUnique(hint.ref, elem.first, std::move(elem)).first;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _IterT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insert(_IterT begin, _IterT end) {
+        // into an empty map, any sorted prefix can be laid down directly
+        if (!sz) begin = appendSorted(begin, end, true);
+        for (; begin != end; begin++) {
+            insert(this->end(), *begin);
+        }
+    }
+
+    // replaces the contents with [first, last), in linear time if sorted
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _IterT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::assign_sorted(_IterT first, _IterT last) {
+        clear();
+        insert(first, last);
+    }
+
+    // the key is only known once the value exists, so the node is built
+    // first and thrown away again if the key turns out to be present
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::emplace(_Args &&...args) {
+        return emplaceNode(NULL, createNode(randomLevel(), std::forward<_Args>(args)...));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::emplace_hint(Iterator hint, _Args &&...args) {
+        return emplaceNode(hint.ref, createNode(randomLevel(), std::forward<_Args>(args)...)).first;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::try_emplace(const _KeyT &k, _Args &&...args) {
+        return insertUnique(NULL, k, std::piecewise_construct,
+                std::forward_as_tuple(k), std::forward_as_tuple(std::forward<_Args>(args)...));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::try_emplace(_KeyT &&k, _Args &&...args) {
+        return insertUnique(NULL, k, std::piecewise_construct,
+                std::forward_as_tuple(std::move(k)), std::forward_as_tuple(std::forward<_Args>(args)...));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase(Iterator pos) {
+        SkipNode *node = pos.ref;
+        SkipNode *history[maxHeight];
+        findPredecessors(node->value()->first, history);
+        unlinkNode(node, history);
+        destroyNode(node);
+    }
+
+    /*
+     * Removes [first, last) by finding the predecessors of both ends and
+     * splicing every level across the gap once, so the only per-element
+     * work is destroying the nodes themselves.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase(Iterator first, Iterator last) {
+        if (first == last) return last;
+
+        SkipNode *firstHistory[maxHeight], *lastHistory[maxHeight];
+        size_t firstRanks[maxHeight] = {}, lastRanks[maxHeight] = {};
+        findNodePredecessors(first.ref, firstHistory, firstRanks);
+        findNodePredecessors(last.ref, lastHistory, lastRanks);
+
+        size_t count = lastRanks[0] - firstRanks[0];
+        for (int i = 0; i < levels; i++) {
+            SkipLink &before = firstHistory[i]->links[i];
+            SkipLink &after = lastHistory[i]->links[i];
+            before.width = lastRanks[i] + after.width - firstRanks[i] - count;
+            before.next = after.next;
+        }
+        last.ref->prev = first.ref->prev;
+        dropEmptyLevels();
+        if (small) unorderSmall(firstRanks[0], lastRanks[0]);
+        fingerValid = false;
+
+        SkipNode *curr = first.ref;
+        while (curr != last.ref) {
+            SkipNode *temp = curr;
+            curr = curr->links[0].next;
+            destroyNode(temp);
+        }
+        sz -= count;
+        demoteSmall();
+        return last;
+    }
+
+    // erases every element with a key in [lo, hi), returning how many went
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase_range(const _KeyT &lo, const _KeyT &hi) {
+        if (!comp(lo, hi)) return 0;
+        size_t before = sz;
+        erase(lower_bound(lo), lower_bound(hi));
+        return before - sz;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase(const _KeyT &k) {
+        SkipNode *history[maxHeight];
+        SkipNode *node = findPredecessors(k, history);
+        if (node == tail || comp(k, node->value()->first)) {
+            throw std::out_of_range("Map<>::erase : Could not find specified key in map.");
+        }
+        unlinkNode(node, history);
+        destroyNode(node);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _C, typename, typename>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::erase(const _KT &k) {
+        SkipNode *history[maxHeight];
+        SkipNode *node = findPredecessors(k, history);
+        if (node == tail || comp(k, node->value()->first)) {
+            throw std::out_of_range("Map<>::erase : Could not find specified key in map.");
+        }
+        unlinkNode(node, history);
+        destroyNode(node);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::clear() {
+        destroyAll(NULL);
+    }
+
+    // empties the map, skipping the value of dead, which is already gone
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::destroyAll(SkipNode *dead) {
+        // nodes are returned to the allocator slab by slab, so the list
+        // only needs walking when the values have destructors to run
+        if (!std::is_trivially_destructible<_ValT>::value) {
+            for (SkipNode *curr = head->links[0].next; curr != tail; curr = curr->links[0].next) {
+                if (curr != dead) curr->value()->~_ValT();
             }
-            bottomHead->next = tempSent;
-            tempSent->prev = bottomHead;
+        }
+        pool.release();
+        small = true;
+
+        linkSentinels();
+        sz = 0;
+        fingerValid = false;
     }
 
-    template <typename _KeyT, typename _MapT>
-    bool Map<_KeyT, _MapT>::operator==(const Map &rhs) {
+    // the sentinels stay where they are: their links, the pools and the
+    // small indexes are exchanged, and each side then repoints its first
+    // and last elements, so this is O(1). Iterators follow their elements
+    // to m.
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::swap(Map &m) noexcept {
+        if (this == &m) return;
+        pool.swap(m.pool);
+        std::swap(comp, m.comp);
+        for (int i = 0; i < std::max(levels, m.levels); i++) {
+            std::swap(head->links[i], m.head->links[i]);
+        }
+        std::swap(tail->prev, m.tail->prev);
+        std::swap(levels, m.levels);
+        std::swap(sz, m.sz);
+        std::swap(smallOrder, m.smallOrder);
+        std::swap(smallCapacity, m.smallCapacity);
+        std::swap(small, m.small);
+        adoptEnds();
+        m.adoptEnds();
+        fingerValid = m.fingerValid = false;
+    }
+
+    /*
+     * One pass down both lists rebuilds the two maps by appending. When
+     * the allocators agree, m's pool is taken over and its nodes are
+     * relinked here as they are, so iterators to them now lead into this
+     * map. m's nodes whose keys are here already move to fresh ones m
+     * keeps; that is only done when the moves cannot throw. Otherwise, and with unequal
+     * allocators, each element taken gets a new node and m's is freed.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::merge(Map &m) {
+        if (this == &m || !m.sz) return;
+
+        size_t duplicates[maxHeight] = {};
+        bool steal = get_allocator() == m.get_allocator();
+        if (steal && countDuplicates(m, duplicates) && !std::is_nothrow_move_constructible<_ValT>::value) steal = false;
+
+        if (steal) {
+            // blocks for the duplicates are set aside first, so that
+            // taking them during the pass cannot fail
+            SlabPool<_AllocT, maxHeight> kept(m.get_allocator());
+            for (int h = 1; h <= maxHeight; h++) {
+                for (size_t i = 0; i < duplicates[h - 1]; i++) {
+                    kept.deallocate(kept.allocate(h - 1, nodeBytes(h)), h - 1);
+                }
+            }
+            pool.absorb(m.pool);
+            m.pool.swap(kept);
+        }
+
+        SkipNode *rightMostNodes[maxHeight], *mRightMostNodes[maxHeight];
+        size_t rightMostRanks[maxHeight], mRightMostRanks[maxHeight];
+        SkipNode *a = unlinkAll(rightMostNodes, rightMostRanks);
+        SkipNode *b = m.unlinkAll(mRightMostNodes, mRightMostRanks);
+        try {
+            while (b != m.tail) {
+                if (a != tail && comp(a->value()->first, b->value()->first)) {
+                    SkipNode *next = a->links[0].next;
+                    appendNode(a, rightMostNodes, rightMostRanks);
+                    a = next;
+                    continue;
+                }
+
+                SkipNode *next = b->links[0].next;
+                SkipNode *node = b;
+                if (a != tail && !comp(b->value()->first, a->value()->first)) {
+                    SkipNode *aNext = a->links[0].next;
+                    appendNode(a, rightMostNodes, rightMostRanks);
+                    a = aNext;
+                    if (steal) {
+                        node = static_cast<SkipNode *>(m.pool.allocate(b->height - 1, nodeBytes(b->height)));
+                        node->height = b->height;
+                        new (node->value()) _ValT(std::move(*b->value()));
+                        setPrefix(node);
+                        b->value()->~_ValT();
+                        pool.deallocate(b, b->height - 1);
+                    }
+                    m.appendNode(node, mRightMostNodes, mRightMostRanks);
+                } else {
+                    if (!steal) {
+                        node = createNode(b->height, std::move(*b->value()));
+                        m.destroyNode(b);
+                    }
+                    appendNode(node, rightMostNodes, rightMostRanks);
+                }
+                b = next;
+            }
+        } catch (...) {
+            // everything not yet placed is greater than what was, so it
+            // goes back on the end of the map it came from
+            for (SkipNode *next; a != tail; a = next) {
+                next = a->links[0].next;
+                appendNode(a, rightMostNodes, rightMostRanks);
+            }
+            for (SkipNode *next; b != m.tail; b = next) {
+                next = b->links[0].next;
+                m.appendNode(b, mRightMostNodes, mRightMostRanks);
+            }
+            finishAppend(rightMostNodes, rightMostRanks);
+            m.finishAppend(mRightMostNodes, mRightMostRanks);
+            throw;
+        }
+        for (SkipNode *next; a != tail; a = next) {
+            next = a->links[0].next;
+            appendNode(a, rightMostNodes, rightMostRanks);
+        }
+        finishAppend(rightMostNodes, rightMostRanks);
+        m.finishAppend(mRightMostNodes, mRightMostRanks);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::merge(Map &&m) {
+        merge(m);
+    }
+
+    /*
+     * Written to a temporary file that replaces path only once complete,
+     * so a failed save leaves any earlier snapshot in place. The file and
+     * then its directory are synced, so once save() returns the snapshot
+     * survives a power loss and callers may drop what it replaces.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _VT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::save(const std::string &path) const {
+        static_assert(std::is_same<_KT, _KeyT>::value && std::is_same<_VT, _MapT>::value, "a snapshot holds the map's own types");
+        typedef SnapshotCodec<_KT> _KeyCodecT;
+        typedef SnapshotCodec<_VT> _MapCodecT;
+        constexpr bool raw = _KeyCodecT::raw && _MapCodecT::raw;
+
+        std::string temp = path + ".tmp";
+        std::FILE *f = std::fopen(temp.c_str(), "wb");
+        if (!f) throw std::system_error(errno, std::generic_category(), temp);
+        std::setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+        SnapshotHeader header;
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.flags = raw ? SNAPSHOT_RAW : 0;
+        header.keyBytes = raw ? sizeof(_KeyT) : 0;
+        header.valueBytes = raw ? sizeof(_MapT) : 0;
+        header.count = sz;
+        std::fwrite(&header, sizeof(header), 1, f);
+        for (SkipNode *curr = head->links[0].next; curr != tail; curr = curr->links[0].next) {
+            _KeyCodecT::write(f, curr->value()->first);
+            _MapCodecT::write(f, curr->value()->second);
+        }
+
+        bool failed = std::fflush(f) != 0 || ::fsync(::fileno(f)) != 0 || std::ferror(f);
+        int err = errno;
+        if (std::fclose(f) != 0 && !failed) {
+            failed = true;
+            err = errno;
+        }
+        if (!failed && std::rename(temp.c_str(), path.c_str()) != 0) {
+            failed = true;
+            err = errno;
+        }
+        if (failed) {
+            std::remove(temp.c_str());
+            throw std::system_error(err, std::generic_category(), path);
+        }
+
+        // the rename is only durable once the directory entry is
+        syncDirectory(path);
+    }
+
+    /*
+     * The file is mapped and its records appended in one pass, with no
+     * search, exactly as a sorted bulk load; records out of order mean
+     * the file is corrupt. The map is rebuilt aside and swapped in, so a
+     * bad file leaves the current contents alone.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT, typename _VT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::load(const std::string &path) {
+        static_assert(std::is_same<_KT, _KeyT>::value && std::is_same<_VT, _MapT>::value, "a snapshot holds the map's own types");
+        typedef SnapshotReader<_KT, _VT> _ReaderT;
+        constexpr bool raw = SnapshotCodec<_KT>::raw && SnapshotCodec<_VT>::raw;
+
+        MappedFile file(path);
+        SnapshotHeader header;
+        if (file.bytes < sizeof(header)) throw std::runtime_error("Not a snapshot: " + path);
+        std::memcpy(&header, file.data, sizeof(header));
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION) {
+            throw std::runtime_error("Not a snapshot: " + path);
+        }
+        if (header.flags != (raw ? SNAPSHOT_RAW : 0) ||
+            header.keyBytes != (raw ? sizeof(_KeyT) : 0) || header.valueBytes != (raw ? sizeof(_MapT) : 0)) {
+            throw std::runtime_error("Snapshot holds other types: " + path);
+        }
+        const char *records = file.data + sizeof(header);
+        const char *end = file.data + file.bytes;
+        if (raw && uint64_t(end - records) / (sizeof(_KeyT) + sizeof(_MapT)) != header.count) {
+            throw std::runtime_error("Truncated snapshot: " + path);
+        }
+
+        Map loaded(comp, get_allocator());
+        _ReaderT last(end, end, 0);
+        _ReaderT stop = loaded.appendSorted(_ReaderT(records, end, header.count), last, true);
+        if (stop != last || stop.position() != end) throw std::runtime_error("Corrupt snapshot: " + path);
+        swap(loaded);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator==(const Map &rhs) {
         if (sz == rhs.sz) {
-            SkipNode *curr = bottomHead->next;
-            SkipNode *rhsCurr = rhs.bottomHead->next;
-            while (!(curr->end)) {
-                if (*curr->value != *rhsCurr->value) return false;
-                curr = curr->next;
-                rhsCurr = rhsCurr->next;
+            SkipNode *curr = head->links[0].next;
+            SkipNode *rhsCurr = rhs.head->links[0].next;
+            while (curr != tail) {
+                if (!valueEqual(*curr->value(), *rhsCurr->value())) return false;
+                curr = curr->links[0].next;
+                rhsCurr = rhsCurr->links[0].next;
             }
             return true;
         } else {
@@ -627,22 +1606,22 @@ namespace cs540 {
         }
     }
 
-    template <typename _KeyT, typename _MapT>
-    bool Map<_KeyT, _MapT>::operator!=(const Map &rhs) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator!=(const Map &rhs) {
         return !(*this == rhs);
     }
 
-    template <typename _KeyT, typename _MapT>
-    bool Map<_KeyT, _MapT>::operator<(const Map &rhs) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::operator<(const Map &rhs) {
         if (sz < rhs.sz) {
-            SkipNode *curr = bottomHead->next;
-            SkipNode *rCurr = rhs.bottomHead->next;
+            SkipNode *curr = head->links[0].next;
+            SkipNode *rCurr = rhs.head->links[0].next;
             bool equal = true;
-            while (!(curr->end)) {
-                if (*curr->value < *rCurr->value) return true;
-                if (*curr->value != *rCurr->value) equal = false;
-                curr = curr->next;
-                rCurr = rCurr->next;
+            while (curr != tail) {
+                if (valueLess(*curr->value(), *rCurr->value())) return true;
+                if (!valueEqual(*curr->value(), *rCurr->value())) equal = false;
+                curr = curr->links[0].next;
+                rCurr = rCurr->links[0].next;
             }
             if (equal) return true;
             else return false;
@@ -651,95 +1630,986 @@ namespace cs540 {
         }
     }
 
+    /*
+     * SET OPERATIONS
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> mergeMaps(MergeKind kind, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &a, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &b) {
+        typedef Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> _MapType;
+        typedef MergeReader<typename _MapType::ConstIterator, typename _MapType::_ValT, _CompT> _ReaderT;
+        _MapType result(a.key_comp(), a.get_allocator());
+        result.insert(_ReaderT(kind, a.begin(), a.end(), b.begin(), b.end(), a.key_comp()), _ReaderT(a.end(), b.end(), a.key_comp()));
+        return result;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_union(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &a, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &b) {
+        return mergeMaps(merge_union, a, b);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_intersection(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &a, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &b) {
+        return mergeMaps(merge_intersection, a, b);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> set_difference(const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &a, const Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &b) {
+        return mergeMaps(merge_difference, a, b);
+    }
+
+    /*
+     * PRIVATE HELPERS
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nodeBytes(int height) {
+        return sizeof(SkipNode) + (height - 1) * sizeof(SkipLink);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::allocNode(int height) {
+        SkipNode *node = static_cast<SkipNode *>(pool.allocate(height - 1, nodeBytes(height)));
+        node->prev = NULL;
+        node->height = height;
+        return node;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::freeNode(SkipNode *node) {
+        pool.deallocate(node, node->height - 1);
+    }
+
+    // the links a node has in the list: only level 0 while small
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    int Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::linkedHeight(const SkipNode *node) const {
+        return small ? 1 : node->height;
+    }
+
+    /*
+     * Doubles the index, up to SMALL_MAP_ELEMENTS. Returns false, leaving
+     * it as it was, once it is that large or if the allocation fails;
+     * either way the caller leaves small mode instead, which needs no
+     * memory, so adding a node never fails here.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::growSmall() {
+        if (smallCapacity >= SMALL_MAP_ELEMENTS) return false;
+        size_t capacity = std::min<size_t>(smallCapacity ? 2 * smallCapacity : SMALL_MAP_FIRST, SMALL_MAP_ELEMENTS);
+        _OrderAllocT orderAlloc(pool.get_allocator());
+        SkipNode **order;
+        try {
+            order = std::allocator_traits<_OrderAllocT>::allocate(orderAlloc, capacity);
+        } catch (...) {
+            return false;
+        }
+        std::copy(smallOrder, smallOrder + sz, order);
+        if (smallOrder) std::allocator_traits<_OrderAllocT>::deallocate(orderAlloc, smallOrder, smallCapacity);
+        smallOrder = order;
+        smallCapacity = capacity;
+        return true;
+    }
+
+    // leaves small mode, appending the indexed nodes again with their
+    // towers; the append state is left for more nodes to follow
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::promoteSmall(SkipNode **rightMostNodes, size_t *rightMostRanks) {
+        size_t n = sz;
+        small = false;
+        sz = 0;
+        linkSentinels();
+        rightMostNodes[0] = head;
+        rightMostRanks[0] = 0;
+        for (size_t i = 0; i < n; i++) {
+            appendNode(smallOrder[i], rightMostNodes, rightMostRanks);
+        }
+        fingerValid = false;
+    }
+
+    // back to small mode once the map is down to half of what the index
+    // holds; the towers above level 0 are simply no longer followed
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::demoteSmall() {
+        if (small || sz > smallCapacity / 2) return;
+        size_t i = 0;
+        for (SkipNode *curr = head->links[0].next; curr != tail; curr = curr->links[0].next) {
+            smallOrder[i++] = curr;
+        }
+        levels = 1;
+        small = true;
+        fingerValid = false;
+    }
+
+    // drops positions [first, last) from the index, sz not yet updated
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::unorderSmall(size_t first, size_t last) {
+        std::copy(smallOrder + last, smallOrder + sz, smallOrder + first);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::releaseSmall() {
+        if (!smallOrder) return;
+        _OrderAllocT orderAlloc(pool.get_allocator());
+        std::allocator_traits<_OrderAllocT>::deallocate(orderAlloc, smallOrder, smallCapacity);
+        smallOrder = NULL;
+        smallCapacity = 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::createNode(int height, _Args &&...args) {
+        SkipNode *node = allocNode(height);
+        try {
+            new (node->value()) _ValT(std::forward<_Args>(args)...);
+        } catch (...) {
+            freeNode(node);
+            throw;
+        }
+        setPrefix(node);
+        return node;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::setPrefix(SkipNode *node) {
+        if constexpr (_PrefixT::enabled) {
+            node->prefix = _PrefixT::make(node->value()->first);
+        }
+    }
+
+    // a probe that cannot be summarised gets 0, which nodeBefore and
+    // nodeAfter never look at
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    uint64_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::probePrefix(const _KT &k) {
+        if constexpr (_PrefixT::enabled && _PrefixT::template accepts<_KT>::value) {
+            return _PrefixT::make(k);
+        } else {
+            return 0;
+        }
+    }
+
+    // comp(node's key, k), settled by the prefixes when they differ
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nodeBefore(const SkipNode *node, const _KT &k, uint64_t prefix) const {
+        if constexpr (_PrefixT::enabled && _PrefixT::template accepts<_KT>::value) {
+            if (node->prefix != prefix) return node->prefix < prefix;
+        }
+        return comp(node->value()->first, k);
+    }
+
+    // comp(k, node's key), settled by the prefixes when they differ
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nodeAfter(const SkipNode *node, const _KT &k, uint64_t prefix) const {
+        if constexpr (_PrefixT::enabled && _PrefixT::template accepts<_KT>::value) {
+            if (node->prefix != prefix) return prefix < node->prefix;
+        }
+        return comp(k, node->value()->first);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::destroyNode(SkipNode *node) {
+        node->value()->~_ValT();
+        freeNode(node);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::init() {
+        head->prev = NULL;
+        head->height = maxHeight;
+        tail->height = 1;
+        tail->links[0].next = NULL;
+        tail->links[0].width = 0;
+        linkSentinels();
+    }
+
+    // the destructor, also used to back out of a constructor that throws
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::teardown() {
+        clear();
+        releaseSmall();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::linkSentinels() {
+        head->links[0].next = tail;
+        head->links[0].width = 1;
+        tail->prev = head;
+        levels = 1;
+    }
+
+    // after swap has exchanged the sentinel links, the first and last
+    // elements still point at the other map's sentinels
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::adoptEnds() {
+        if (!sz) {
+            linkSentinels();
+            return;
+        }
+        head->links[0].next->prev = head;
+        tail->prev->links[0].next = tail;
+    }
+
+    // true past the last node on any level
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::atEnd(const SkipNode *node) const {
+        return !node || node == tail;
+    }
+
+    // what the last link on level i points at
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::levelEnd(int i) const {
+        return i ? NULL : tail;
+    }
+
+    // appends copies of m's elements from `from` on, with the same heights;
+    // they must all be greater than anything already here
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::copyFrom(const SkipNode *from, const Map &m) {
+        SkipNode *rightMostNodes[maxHeight];
+        size_t rightMostRanks[maxHeight];
+        findNodePredecessors(tail, rightMostNodes, rightMostRanks);
+
+        try {
+            for (const SkipNode *curr = from; curr != m.tail; curr = curr->links[0].next) {
+                appendNode(createNode(curr->height, *curr->value()), rightMostNodes, rightMostRanks);
+            }
+        } catch (...) {
+            finishAppend(rightMostNodes, rightMostRanks);
+            throw;
+        }
+        finishAppend(rightMostNodes, rightMostRanks);
+    }
+
+    /*
+     * Appending: rightMostNodes/rightMostRanks hold the last node on every
+     * level and its position. Each appended node closes the width of the
+     * links it takes over; finishAppend closes the ones left at the end
+     * of their level.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::appendNode(SkipNode *node, SkipNode **rightMostNodes, size_t *rightMostRanks) {
+        if (small && sz == smallCapacity && !growSmall()) promoteSmall(rightMostNodes, rightMostRanks);
+        if (small) smallOrder[sz] = node;
+
+        size_t rank = sz + 1;
+        int height = linkedHeight(node);
+        for (; levels < height; levels++) {
+            rightMostNodes[levels] = head;
+            rightMostRanks[levels] = 0;
+        }
+        node->prev = rightMostNodes[0];
+        for (int i = 0; i < height; i++) {
+            rightMostNodes[i]->links[i].next = node;
+            rightMostNodes[i]->links[i].width = rank - rightMostRanks[i];
+            node->links[i].next = levelEnd(i);
+            rightMostNodes[i] = node;
+            rightMostRanks[i] = rank;
+        }
+        tail->prev = node;
+        sz++;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::finishAppend(SkipNode **rightMostNodes, size_t *rightMostRanks) {
+        for (int i = 0; i < levels; i++) {
+            rightMostNodes[i]->links[i].width = sz + 1 - rightMostRanks[i];
+        }
+    }
+
+    // empties the map without freeing anything and sets up appending;
+    // the old nodes stay chained on level 0 from the one returned to tail
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::unlinkAll(SkipNode **rightMostNodes, size_t *rightMostRanks) {
+        SkipNode *first = head->links[0].next;
+        linkSentinels();
+        sz = 0;
+        small = true;
+        fingerValid = false;
+        rightMostNodes[0] = head;
+        rightMostRanks[0] = 0;
+        return first;
+    }
+
+    // counts m's nodes with a key that is also here, by height
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    size_t Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::countDuplicates(const Map &m, size_t *byHeight) const {
+        size_t n = 0;
+        const SkipNode *curr = head->links[0].next, *mCurr = m.head->links[0].next;
+        while (curr != tail && mCurr != m.tail) {
+            if (comp(curr->value()->first, mCurr->value()->first)) {
+                curr = curr->links[0].next;
+            } else if (comp(mCurr->value()->first, curr->value()->first)) {
+                mCurr = mCurr->links[0].next;
+            } else {
+                byHeight[mCurr->height - 1]++;
+                n++;
+                curr = curr->links[0].next;
+                mCurr = mCurr->links[0].next;
+            }
+        }
+        return n;
+    }
+
+    // splices node in after the predecessors left in the finger by
+    // findInsertPath, first raising the head to the node's height if it
+    // is the tallest yet. The finger stays valid: it now leads to node,
+    // and nothing on it changed rank. findInsertPath has made room for
+    // the node in the index if the map is small.
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::linkNode(SkipNode *node) {
+        int height = linkedHeight(node);
+        for (; levels < height; levels++) {
+            head->links[levels].next = NULL;
+            head->links[levels].width = sz + 1;
+            finger[levels] = head;
+            fingerRanks[levels] = 0;
+        }
+
+        size_t nodeRank = fingerRanks[0] + 1;
+        if (small) {
+            std::copy_backward(smallOrder + nodeRank - 1, smallOrder + sz, smallOrder + sz + 1);
+            smallOrder[nodeRank - 1] = node;
+        }
+        for (int i = 0; i < height; i++) {
+            SkipLink &before = finger[i]->links[i];
+            node->links[i].next = before.next;
+            node->links[i].width = before.width - (nodeRank - fingerRanks[i]) + 1;
+            before.next = node;
+            before.width = nodeRank - fingerRanks[i];
+        }
+        for (int i = height; i < levels; i++) {
+            finger[i]->links[i].width++;
+        }
+        node->prev = finger[0];
+        node->links[0].next->prev = node;
+        sz++;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::unlinkNode(SkipNode *node, SkipNode **history) {
+        int height = linkedHeight(node);
+        for (int i = 0; i < height; i++) {
+            SkipLink &before = history[i]->links[i];
+            before.next = node->links[i].next;
+            before.width += node->links[i].width - 1;
+        }
+        for (int i = height; i < levels; i++) {
+            history[i]->links[i].width--;
+        }
+        node->links[0].next->prev = node->prev;
+        if (small) {
+            size_t pos = std::find(smallOrder, smallOrder + sz, node) - smallOrder;
+            unorderSmall(pos, pos + 1);
+        }
+        sz--;
+        dropEmptyLevels();
+        demoteSmall();
+        fingerValid = false;
+    }
+
+    // lowers the head past levels the last erase left with no towers
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::dropEmptyLevels() {
+        while (levels > 1 && !head->links[levels - 1].next) levels--;
+    }
+
+    // position i counts from 0; anything past the last element is tail
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::nthNode(size_t i) const {
+        if (i >= sz) return tail;
+        if (small) return smallOrder[i];
+
+        size_t remaining = i + 1;
+        SkipNode *curr = head;
+        for (int lvl = levels - 1; lvl >= 0; lvl--) {
+            while (curr->links[lvl].width <= remaining) {
+                remaining -= curr->links[lvl].width;
+                curr = curr->links[lvl].next;
+            }
+        }
+        return curr;
+    }
+
+    // constructs the value from args only if k is not already present
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename... _Args>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::insertUnique(SkipNode *hint, const _KeyT &k, _Args &&...args) {
+        SkipNode *curr = findInsertPath(hint, k);
+        if (curr != tail && !comp(k, curr->value()->first)) {
+            return std::pair<Iterator, bool>{Iterator(curr), false};
+        }
+
+        SkipNode *node = createNode(randomLevel(), std::forward<_Args>(args)...);
+        linkNode(node);
+        return std::pair<Iterator, bool>{Iterator(node), true};
+    }
+
+    // links an already constructed node, or destroys it if its key is taken
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    std::pair<typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator, bool> Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::emplaceNode(SkipNode *hint, SkipNode *node) {
+        SkipNode *curr = findInsertPath(hint, node->value()->first);
+        if (curr != tail && !comp(node->value()->first, curr->value()->first)) {
+            destroyNode(node);
+            return std::pair<Iterator, bool>{Iterator(curr), false};
+        }
+
+        linkNode(node);
+        return std::pair<Iterator, bool>{Iterator(node), true};
+    }
+
+    /*
+     * Leaves the predecessors of k in the finger and returns the first node
+     * not less than k, after making room for one more node in small mode. Hints that point at the node the finger leads to or
+     * just past it (the usual shape of a sorted stream, walking either up
+     * or down) move the finger from where it is; anything else searches
+     * from head.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findInsertPath(SkipNode *hint, const _KeyT &k) {
+        if (small && sz == smallCapacity && !growSmall()) {
+            SkipNode *rightMostNodes[maxHeight];
+            size_t rightMostRanks[maxHeight];
+            promoteSmall(rightMostNodes, rightMostRanks);
+            finishAppend(rightMostNodes, rightMostRanks);
+        }
+        if (hint && fingerValid) {
+            SkipNode *last = finger[0]->links[0].next;
+            if (hint == last || (last != tail && hint == last->links[0].next)) {
+                SkipNode *ret = moveFinger(k);
+                if (ret) return ret;
+            }
+        }
+        fingerValid = true;
+        return findPredecessors(k, finger, fingerRanks);
+    }
+
+    /*
+     * Finger search: climbs the path only as far as the first level whose
+     * next node is not before k, then descends from there, keeping the
+     * saved nodes on the way down whenever they are further right. Costs
+     * O(log d) for a key d positions past the finger. Returns NULL, leaving
+     * the finger alone, when k is not after it, since it cannot move left.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::moveFinger(const _KeyT &k) {
+        uint64_t prefix = probePrefix(k);
+        if (finger[0] != head && !nodeBefore(finger[0], k, prefix)) return NULL;
+
+        int lvl = 0;
+        while (lvl < levels && !atEnd(finger[lvl]->links[lvl].next)
+                && nodeBefore(finger[lvl]->links[lvl].next, k, prefix)) {
+            lvl++;
+        }
+
+        int top = (lvl < levels) ? lvl : levels - 1;
+        SkipNode *curr = finger[top];
+        size_t rank = fingerRanks[top];
+        for (int i = (lvl < levels) ? lvl - 1 : levels - 1; i >= 0; i--) {
+            if (fingerRanks[i] > rank) {
+                curr = finger[i];
+                rank = fingerRanks[i];
+            }
+            while (!atEnd(curr->links[i].next) && nodeBefore(curr->links[i].next, k, prefix)) {
+                rank += curr->links[i].width;
+                curr = curr->links[i].next;
+            }
+            finger[i] = curr;
+            fingerRanks[i] = rank;
+        }
+        return curr->links[0].next;
+    }
+
+    /*
+     * Bulk load into an empty map. Elements are appended in order, and the
+     * i-th one (counting from 1) takes its height from the level policy's
+     * balanced(i): with PromoteHalf every 2^k-th element reaches level k
+     * and the result is perfectly balanced. When checked, stops at the first element that
+     * is not greater than the one before and returns where it stopped.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _IterT>
+    _IterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::appendSorted(_IterT first, _IterT last, bool checked) {
+        SkipNode *rightMostNodes[maxHeight];
+        size_t rightMostRanks[maxHeight];
+        findNodePredecessors(tail, rightMostNodes, rightMostRanks);
+
+        try {
+            for (; first != last; ++first) {
+                if (checked && sz && !comp(tail->prev->value()->first, (*first).first)) break;
+
+                appendNode(createNode(_LevelsT::balanced(sz + 1), *first), rightMostNodes, rightMostRanks);
+            }
+        } catch (...) {
+            finishAppend(rightMostNodes, rightMostRanks);
+            throw;
+        }
+        finishAppend(rightMostNodes, rightMostRanks);
+        return first;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    int Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::randomLevel() {
+        return _LevelsT::height(rng.next());
+    }
+
+    // returns the first node not less than k, filling history (if given)
+    // with the rightmost node before it on every level and ranks (if
+    // given) with the position of each of those nodes, head being 0
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findPredecessors(const _KT &k, SkipNode **history, size_t *ranks) const {
+        if (small) return findSmall(k, history, ranks);
+
+        SkipNode *curr = head;
+        size_t rank = 0;
+        uint64_t prefix = probePrefix(k);
+        for (int i = levels - 1; i >= 0; i--) {
+            while (!atEnd(curr->links[i].next) && nodeBefore(curr->links[i].next, k, prefix)) {
+                rank += curr->links[i].width;
+                curr = curr->links[i].next;
+            }
+            if (history) history[i] = curr;
+            if (ranks) ranks[i] = rank;
+        }
+        return curr->links[0].next;
+    }
+
+    // findPredecessors in small mode, where level 0 is the only one
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findSmall(const _KT &k, SkipNode **history, size_t *ranks) const {
+        SkipNode *const *order = smallOrder;
+        uint64_t prefix = probePrefix(k);
+        size_t lo = 0, hi = sz;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (nodeBefore(order[mid], k, prefix)) lo = mid + 1;
+            else hi = mid;
+        }
+        if (history) history[0] = lo ? order[lo - 1] : head;
+        if (ranks) ranks[0] = lo;
+        return (lo < sz) ? order[lo] : tail;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findSmallUpper(const _KT &k) const {
+        SkipNode *const *order = smallOrder;
+        uint64_t prefix = probePrefix(k);
+        size_t lo = 0, hi = sz;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (!nodeAfter(order[mid], k, prefix)) lo = mid + 1;
+            else hi = mid;
+        }
+        return (lo < sz) ? order[lo] : tail;
+    }
+
+    // returns the first node greater than k
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findUpper(const _KT &k) const {
+        if (small) return findSmallUpper(k);
+
+        SkipNode *curr = head;
+        uint64_t prefix = probePrefix(k);
+        for (int i = levels - 1; i >= 0; i--) {
+            while (!atEnd(curr->links[i].next) && !nodeAfter(curr->links[i].next, k, prefix)) {
+                curr = curr->links[i].next;
+            }
+        }
+        return curr->links[0].next;
+    }
+
+    // findPredecessors for a node already in the list, tail included
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findNodePredecessors(SkipNode *node, SkipNode **history, size_t *ranks) const {
+        if (node != tail) {
+            findPredecessors(node->value()->first, history, ranks);
+            return;
+        }
+        if (small) {
+            history[0] = tail->prev;
+            ranks[0] = sz;
+            return;
+        }
+
+        SkipNode *curr = head;
+        size_t rank = 0;
+        for (int i = levels - 1; i >= 0; i--) {
+            while (!atEnd(curr->links[i].next)) {
+                rank += curr->links[i].width;
+                curr = curr->links[i].next;
+            }
+            history[i] = curr;
+            ranks[i] = rank;
+        }
+    }
+
+    // keys are equal when neither orders before the other
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::valueEqual(const _ValT &a, const _ValT &b) const {
+        return !comp(a.first, b.first) && !comp(b.first, a.first) && a.second == b.second;
+    }
+
+    // lexicographic, like std::pair's operator< but ordering keys by comp
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    bool Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::valueLess(const _ValT &a, const _ValT &b) const {
+        if (comp(a.first, b.first)) return true;
+        if (comp(b.first, a.first)) return false;
+        return a.second < b.second;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _KT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findNode(const _KT &k) const {
+        SkipNode *node = findPredecessors(k, NULL);
+        if (node != tail && !comp(k, node->value()->first)) return node;
+        return tail;
+    }
+
+    /*
+     * Resolves the keys in ascending order with one search path carried
+     * from key to key, so each lookup only climbs as high as the distance
+     * to the previous key requires. A sorted batch costs about one merge
+     * of the keys with the list. Unsorted keys are sorted by position
+     * first and the results put back in the order given, which needs
+     * forward iterators.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _ItT, typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findBatch(_KeyIterT first, _KeyIterT last, _OutIterT out) const {
+        SkipNode *path[maxHeight];
+        std::fill(path, path + levels, head);
+
+        auto keyLess = [this](const _KeyT &a, const _KeyT &b) { return comp(a, b); };
+        if (std::is_sorted(first, last, keyLess)) {
+            for (; first != last; ++first) {
+                SkipNode *node = advancePath(path, *first);
+                *out++ = _ItT((node != tail && !comp(*first, node->value()->first)) ? node : tail);
+            }
+            return out;
+        }
+
+        std::vector<std::pair<_KeyIterT, size_t>> order;
+        for (size_t i = 0; first != last; ++first, ++i) {
+            order.push_back(std::make_pair(first, i));
+        }
+        std::sort(order.begin(), order.end(), [this](const std::pair<_KeyIterT, size_t> &a, const std::pair<_KeyIterT, size_t> &b) {
+            return comp(*a.first, *b.first);
+        });
+
+        std::vector<SkipNode *> found(order.size());
+        for (auto &probe : order) {
+            SkipNode *node = advancePath(path, *probe.first);
+            found[probe.second] = (node != tail && !comp(*probe.first, node->value()->first)) ? node : tail;
+        }
+        for (SkipNode *node : found) {
+            *out++ = _ItT(node);
+        }
+        return out;
+    }
+
+    /*
+     * Runs up to FIND_MANY_WIDTH independent searches in lock-step. Each
+     * one takes a single hop per round and then prefetches the node it
+     * will compare against next, so by the time the round comes back to
+     * it the miss has had the other searches' work to hide behind. Meant
+     * for unsorted keys spread over a map much larger than the cache;
+     * results come out in the order the keys were given.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    template <typename _ItT, typename _KeyIterT, typename _OutIterT>
+    _OutIterT Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::findMany(_KeyIterT first, _KeyIterT last, _OutIterT out) const {
+        // a small map is searched by its index, with nothing to wait on
+        if (small) {
+            for (; first != last; ++first) {
+                *out++ = _ItT(findNode(*first));
+            }
+            return out;
+        }
+
+        int top = levels - 1;
+
+        _KeyIterT keys[FIND_MANY_WIDTH];
+        uint64_t prefixes[FIND_MANY_WIDTH];
+        SkipNode *curr[FIND_MANY_WIDTH];
+        int lvl[FIND_MANY_WIDTH];
+
+        while (first != last) {
+            int n = 0;
+            for (; n < FIND_MANY_WIDTH && first != last; ++first, ++n) {
+                keys[n] = first;
+                prefixes[n] = probePrefix(*first);
+                curr[n] = head;
+                lvl[n] = top;
+            }
+
+            int active = n;
+            while (active) {
+                for (int j = 0; j < n; j++) {
+                    if (lvl[j] < 0) continue;
+
+                    SkipNode *next = curr[j]->links[lvl[j]].next;
+                    if (!atEnd(next) && nodeBefore(next, *keys[j], prefixes[j])) {
+                        curr[j] = next;
+                    } else if (lvl[j]-- == 0) {
+                        curr[j] = (next != tail && !comp(*keys[j], next->value()->first)) ? next : tail;
+                        active--;
+                        continue;
+                    }
+                    __builtin_prefetch(curr[j]->links[lvl[j]].next);
+                }
+            }
+
+            for (int j = 0; j < n; j++) {
+                *out++ = _ItT(curr[j]);
+            }
+        }
+        return out;
+    }
+
+    /*
+     * Moves a search path left by a key not greater than k on to k and
+     * returns the first node not less than k. Levels whose next node is
+     * already past k keep their entry; below the lowest of them the walk
+     * resumes from the old entries until it overtakes one, after which
+     * the old ones are behind it.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::SkipNode *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::advancePath(SkipNode **path, const _KeyT &k) const {
+        uint64_t prefix = probePrefix(k);
+        int lvl = 0;
+        while (lvl < levels && !atEnd(path[lvl]->links[lvl].next)
+                && nodeBefore(path[lvl]->links[lvl].next, k, prefix)) {
+            lvl++;
+        }
+
+        SkipNode *curr = NULL;
+        bool moved = false;
+        for (int i = lvl - 1; i >= 0; i--) {
+            if (!moved) curr = path[i];
+            while (!atEnd(curr->links[i].next) && nodeBefore(curr->links[i].next, k, prefix)) {
+                curr = curr->links[i].next;
+                moved = true;
+            }
+            path[i] = curr;
+        }
+        return path[0]->links[0].next;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    void swap(Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &a, Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT> &b) noexcept {
+        a.swap(b);
+    }
+
     /*
      * ITERATOR
      */
 
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::Iterator::Iterator(SkipNode *r) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::Iterator(SkipNode *r) {
         ref = r;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator &Map<_KeyT, _MapT>::Iterator::operator++() {
-        ref = ref->next;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator++() {
+        ref = ref->links[0].next;
         return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator &Map<_KeyT, _MapT>::Iterator::operator--() {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator--() {
         ref = ref->prev;
         return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator Map<_KeyT, _MapT>::Iterator::operator++(int) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator++(int) {
         Iterator ret(ref);
-        ref = ref->next;
+        ref = ref->links[0].next;
         return ret;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::Iterator Map<_KeyT, _MapT>::Iterator::operator--(int) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator--(int) {
         Iterator ret(ref);
         ref = ref->prev;
         return ret;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::_ValT &Map<_KeyT, _MapT>::Iterator::operator*() const {
-        return *(ref->value);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_ValT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator*() const {
+        return *(ref->value());
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::_ValT *Map<_KeyT, _MapT>::Iterator::operator->() const {
-        return ref->value;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_ValT *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::Iterator::operator->() const {
+        return ref->value();
     }
 
     /*
      * CONST_ITERATOR
      */
-    template <typename _KeyT, typename _MapT>
-    Map<_KeyT, _MapT>::ConstIterator::ConstIterator(const Iterator &i) : Iterator(i.ref) {}
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator::ConstIterator(const Iterator &i) : Iterator(i.ref) {}
 
-    template <typename _KeyT, typename _MapT>
-    const typename Map<_KeyT, _MapT>::_ValT &Map<_KeyT, _MapT>::ConstIterator::operator*() const {
-        return *(this->ref->value);
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    const typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_ValT &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator::operator*() const {
+        return *(this->ref->value());
     }
 
-    template <typename _KeyT, typename _MapT>
-    const typename Map<_KeyT, _MapT>::_ValT *Map<_KeyT, _MapT>::ConstIterator::operator->() const {
-        return this->ref->value;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    const typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::_ValT *Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ConstIterator::operator->() const {
+        return this->ref->value();
     }
 
     /*
      * REVERSE_ITERATOR
      */
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator &Map<_KeyT, _MapT>::ReverseIterator::operator++() {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator::operator++() {
         this->ref = this->ref->prev;
         return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator &Map<_KeyT, _MapT>::ReverseIterator::operator--() {
-        this->ref = this->ref->next;
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator &Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator::operator--() {
+        this->ref = this->ref->links[0].next;
         return *this;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator Map<_KeyT, _MapT>::ReverseIterator::operator++(int) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator::operator++(int) {
         ReverseIterator ret(this->ref);
         this->ref = this->ref->prev;
         return ret;
     }
 
-    template <typename _KeyT, typename _MapT>
-    typename Map<_KeyT, _MapT>::ReverseIterator Map<_KeyT, _MapT>::ReverseIterator::operator--(int) {
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _AllocT, typename _LevelsT>
+    typename Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator Map<_KeyT, _MapT, _CompT, _AllocT, _LevelsT>::ReverseIterator::operator--(int) {
         ReverseIterator ret(this->ref);
-        this->ref = this->ref->next;
+        this->ref = this->ref->links[0].next;
         return ret;
     }
+
+    /*
+     * SLAB_POOL
+     */
+
+    template <typename _AllocT, size_t _NumClasses>
+    SlabPool<_AllocT, _NumClasses>::SlabPool(const _AllocT &a)
+        : alloc(a), nextSlabUnits(unitsFor(SLAB_POOL_MIN_BYTES)) {}
+
+    template <typename _AllocT, size_t _NumClasses>
+    SlabPool<_AllocT, _NumClasses>::~SlabPool() {
+        release();
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    void *SlabPool<_AllocT, _NumClasses>::allocate(size_t sizeClass, size_t bytes) {
+        if (freeLists[sizeClass]) {
+            FreeBlock *block = freeLists[sizeClass];
+            freeLists[sizeClass] = block->next;
+            return block;
+        }
+
+        size_t units = unitsFor(bytes);
+        if (size_t(limit - cursor) < units) {
+            size_t headerUnits = unitsFor(sizeof(Slab));
+            size_t slabUnits = nextSlabUnits;
+            if (slabUnits < headerUnits + units) slabUnits = headerUnits + units;
+            if (nextSlabUnits < unitsFor(SLAB_POOL_MAX_BYTES)) nextSlabUnits *= 2;
+
+            _UnitT *mem = std::allocator_traits<_UnitAllocT>::allocate(alloc, slabUnits);
+            Slab *slab = reinterpret_cast<Slab *>(mem);
+            slab->next = slabs;
+            slab->units = slabUnits;
+            slabs = slab;
+            cursor = mem + headerUnits;
+            limit = mem + slabUnits;
+        }
+
+        void *ret = cursor;
+        cursor += units;
+        return ret;
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    void SlabPool<_AllocT, _NumClasses>::deallocate(void *p, size_t sizeClass) {
+        FreeBlock *block = static_cast<FreeBlock *>(p);
+        block->next = freeLists[sizeClass];
+        freeLists[sizeClass] = block;
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    void SlabPool<_AllocT, _NumClasses>::release() {
+        while (slabs) {
+            Slab *temp = slabs;
+            slabs = slabs->next;
+            std::allocator_traits<_UnitAllocT>::deallocate(alloc, reinterpret_cast<_UnitT *>(temp), temp->units);
+        }
+        for (size_t i = 0; i < _NumClasses; i++) {
+            freeLists[i] = NULL;
+        }
+        cursor = limit = NULL;
+        nextSlabUnits = unitsFor(SLAB_POOL_MIN_BYTES);
+    }
+
+    // p must use an allocator equal to this one's, and is left empty. The
+    // free end of whichever current slab is shorter goes unused until
+    // release().
+    template <typename _AllocT, size_t _NumClasses>
+    void SlabPool<_AllocT, _NumClasses>::absorb(SlabPool &p) {
+        if (p.slabs) {
+            Slab *last = p.slabs;
+            while (last->next) last = last->next;
+            last->next = slabs;
+            slabs = p.slabs;
+        }
+        for (size_t i = 0; i < _NumClasses; i++) {
+            if (!p.freeLists[i]) continue;
+            FreeBlock *last = p.freeLists[i];
+            while (last->next) last = last->next;
+            last->next = freeLists[i];
+            freeLists[i] = p.freeLists[i];
+            p.freeLists[i] = NULL;
+        }
+        if (p.limit - p.cursor > limit - cursor) {
+            cursor = p.cursor;
+            limit = p.limit;
+        }
+        nextSlabUnits = std::max(nextSlabUnits, p.nextSlabUnits);
+
+        p.slabs = NULL;
+        p.cursor = p.limit = NULL;
+        p.nextSlabUnits = unitsFor(SLAB_POOL_MIN_BYTES);
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    void SlabPool<_AllocT, _NumClasses>::swap(SlabPool &p) noexcept {
+        using std::swap;
+        swap(alloc, p.alloc);
+        for (size_t i = 0; i < _NumClasses; i++) {
+            swap(freeLists[i], p.freeLists[i]);
+        }
+        swap(slabs, p.slabs);
+        swap(cursor, p.cursor);
+        swap(limit, p.limit);
+        swap(nextSlabUnits, p.nextSlabUnits);
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    _AllocT SlabPool<_AllocT, _NumClasses>::get_allocator() const {
+        return _AllocT(alloc);
+    }
+
+    template <typename _AllocT, size_t _NumClasses>
+    size_t SlabPool<_AllocT, _NumClasses>::unitsFor(size_t bytes) {
+        return (bytes + sizeof(_UnitT) - 1) / sizeof(_UnitT);
+    }
 }
 
 #endif
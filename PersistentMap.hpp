@@ -0,0 +1,649 @@
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <system_error>
+#include <string>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Map.hpp"
+
+#ifndef __PERSISTENT_MAP_HPP__
+#define __PERSISTENT_MAP_HPP__
+
+#define PERSISTENT_MAP_MAGIC "CS540PMP"
+#define PERSISTENT_MAP_VERSION 1
+
+// size of a new file; it doubles whenever the nodes outgrow it
+#define PERSISTENT_MAP_MIN_BYTES (64 << 10)
+
+namespace cs540 {
+    // tag for opening a persistent map that will only be read
+    struct read_only_t {};
+    constexpr read_only_t read_only{};
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    class PersistentMapView;
+
+    /*
+     * Skip list whose nodes live in a memory mapped file. Links are byte
+     * offsets from the start of the file rather than pointers, so the
+     * file can be mapped anywhere: reopening it is just mapping it again,
+     * with nothing to rebuild. Offset 0 is the file header and doubles as
+     * the null link.
+     *
+     * Any number of processes may open the same file read only at once,
+     * through PersistentMapView; a writable open excludes everyone else. The locks are taken without
+     * waiting, so an open that would conflict throws instead. The
+     * comparator is not stored, so every open must order keys the same.
+     *
+     * Keys and values must be trivially copyable, as they are kept as
+     * bytes. Growing the file may move the mapping, which invalidates
+     * references and pointers to elements but not iterators. Changes
+     * reach the file through the shared mapping; sync() waits for them
+     * to be written, and a crash in the middle of a change can leave the
+     * file inconsistent.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>, typename _LevelsT = PromoteHalf<>>
+    class PersistentMap {
+        static_assert(std::is_trivially_copyable<_KeyT>::value && std::is_trivially_copyable<_MapT>::value,
+                      "persistent keys and values are stored as their bytes");
+        struct Node;
+        static constexpr int maxHeight = _LevelsT::max_height;
+        public:
+            class Iterator;
+            class ConstIterator;
+
+            typedef std::pair<const _KeyT, _MapT> _ValT;
+
+            // constructors and assignment operator
+            explicit PersistentMap(const std::string &, const _CompT & = _CompT());
+            PersistentMap(const PersistentMap &) = delete;
+            PersistentMap(PersistentMap &&);
+            PersistentMap &operator=(const PersistentMap &) = delete;
+            PersistentMap &operator=(PersistentMap &&);
+            ~PersistentMap();
+
+            // size
+            size_t size() const;
+            bool empty() const;
+
+            // iterators
+            Iterator begin();
+            Iterator end();
+            ConstIterator begin() const;
+            ConstIterator end() const;
+
+            // element access
+            Iterator find(const _KeyT &);
+            ConstIterator find(const _KeyT &) const;
+            _MapT &at(const _KeyT &);
+            const _MapT &at(const _KeyT &) const;
+            _MapT &operator[](const _KeyT &);
+            size_t count(const _KeyT &) const;
+            bool contains(const _KeyT &) const;
+            Iterator lower_bound(const _KeyT &);
+            ConstIterator lower_bound(const _KeyT &) const;
+            Iterator upper_bound(const _KeyT &);
+            ConstIterator upper_bound(const _KeyT &) const;
+
+            // modifiers
+            std::pair<Iterator, bool> insert(const _ValT &);
+            void erase(Iterator);
+            void erase(const _KeyT &);
+            void clear();
+            void swap(PersistentMap &);
+
+            // writes every change so far to the file
+            void sync();
+
+            class Iterator {
+                public:
+                    Iterator() = delete;
+                    Iterator(const PersistentMap *m, uint64_t o) : map(m), off(o) {}
+
+                    Iterator &operator++();
+                    Iterator &operator--();
+                    Iterator operator++(int);
+                    Iterator operator--(int);
+
+                    // a ConstIterator from a view that was converted back
+                    // cannot write through the read only mapping
+                    _ValT &operator*() const { map->checkWritable(); return *map->node(off)->value(); }
+                    _ValT *operator->() const { map->checkWritable(); return map->node(off)->value(); }
+
+                    const PersistentMap *map;
+                    uint64_t off;
+
+                    bool operator==(const Iterator &rhs) const { return off == rhs.off && map == rhs.map; }
+                    bool operator!=(const Iterator &rhs) const { return !(*this == rhs); }
+            };
+
+            class ConstIterator : public Iterator {
+                public:
+                    using Iterator::Iterator;
+                    ConstIterator(const Iterator &it) : Iterator(it) {}
+
+                    // stepping keeps the const access
+                    ConstIterator &operator++() { Iterator::operator++(); return *this; }
+                    ConstIterator &operator--() { Iterator::operator--(); return *this; }
+                    ConstIterator operator++(int) { return Iterator::operator++(0); }
+                    ConstIterator operator--(int) { return Iterator::operator--(0); }
+
+                    const _ValT &operator*() const { return *this->map->node(this->off)->value(); }
+                    const _ValT *operator->() const { return this->map->node(this->off)->value(); }
+            };
+
+        private:
+            friend class PersistentMapView<_KeyT, _MapT, _CompT, _LevelsT>;
+
+            PersistentMap(const std::string &, read_only_t, const _CompT &);
+
+            /*
+             * The value is followed by a forward link for every level the
+             * node reaches. Only level 0 links back. Erased nodes are kept
+             * on a free list per height, chained through next[0].
+             */
+            struct Node {
+                _ValT *value() { return reinterpret_cast<_ValT *>(&storage); }
+
+                uint64_t prev;
+                int32_t height;
+                int32_t unused;
+                typename std::aligned_storage<sizeof(_ValT), alignof(_ValT)>::type storage;
+                uint64_t next[1];
+            };
+
+            // everything the file needs to be reopened, at offset 0
+            struct Header {
+                char magic[8];
+                uint32_t version;
+                uint32_t heightCap;
+                uint32_t keyBytes;
+                uint32_t valueBytes;
+                uint64_t fileBytes;
+                uint64_t used;
+                uint64_t count;
+                uint64_t last;
+                uint64_t rngState;
+                int32_t levels;
+                int32_t unused;
+                uint64_t freeLists[maxHeight];
+            };
+
+            // the head node sits right after the header, on its own line
+            static constexpr uint64_t headOffset = (sizeof(Header) + 63) & ~uint64_t(63);
+
+            // mapping
+            void openFile(const std::string &, bool);
+            void format();
+            void validate(const std::string &) const;
+            void grow(uint64_t);
+            void checkWritable() const;
+            Header *header() const { return reinterpret_cast<Header *>(base); }
+            Node *node(uint64_t off) const { return reinterpret_cast<Node *>(base + off); }
+
+            // node allocation
+            static uint64_t nodeBytes(int height);
+            uint64_t allocNode(int height);
+            void freeNode(uint64_t);
+
+            // helpers
+            uint64_t findPredecessors(const _KeyT &, uint64_t *) const;
+            uint64_t findNode(const _KeyT &) const;
+            uint64_t findUpper(const _KeyT &) const;
+            int randomLevel();
+
+            _CompT comp;
+            int fd = -1;
+            bool writable = false;
+            char *base = NULL;
+            size_t mappedBytes = 0;
+    };
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::PersistentMap(const std::string &path, const _CompT &c) : comp(c) {
+        openFile(path, true);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::PersistentMap(const std::string &path, read_only_t, const _CompT &c) : comp(c) {
+        openFile(path, false);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::PersistentMap(PersistentMap &&m) : comp(m.comp) {
+        swap(m);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    PersistentMap<_KeyT, _MapT, _CompT, _LevelsT> &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::operator=(PersistentMap &&m) {
+        if (this != &m) {
+            PersistentMap temp(std::move(m));
+            swap(temp);
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::~PersistentMap() {
+        if (base) ::munmap(base, mappedBytes);
+        if (fd >= 0) ::close(fd);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    size_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::size() const {
+        return header()->count;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    bool PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::empty() const {
+        return (header()->count) ? false : true;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::begin() {
+        return Iterator(this, node(headOffset)->next[0]);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::end() {
+        return Iterator(this, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::begin() const {
+        return ConstIterator(this, node(headOffset)->next[0]);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::end() const {
+        return ConstIterator(this, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::find(const _KeyT &k) {
+        return Iterator(this, findNode(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::find(const _KeyT &k) const {
+        return ConstIterator(this, findNode(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    _MapT &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::at(const _KeyT &k) {
+        uint64_t off = findNode(k);
+        if (!off) {
+            throw std::out_of_range("PersistentMap<>::at : Could not find specified key in map.");
+        }
+        return node(off)->value()->second;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    const _MapT &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::at(const _KeyT &k) const {
+        uint64_t off = findNode(k);
+        if (!off) {
+            throw std::out_of_range("const PersistentMap<>::at : Could not find specified key in map.");
+        }
+        return node(off)->value()->second;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    _MapT &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::operator[](const _KeyT &k) {
+        return insert(_ValT(k, _MapT())).first->second;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    size_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::count(const _KeyT &k) const {
+        return findNode(k) ? 1 : 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    bool PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::contains(const _KeyT &k) const {
+        return findNode(k) != 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::lower_bound(const _KeyT &k) {
+        return Iterator(this, findPredecessors(k, NULL));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::lower_bound(const _KeyT &k) const {
+        return ConstIterator(this, findPredecessors(k, NULL));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::upper_bound(const _KeyT &k) {
+        return Iterator(this, findUpper(k));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::upper_bound(const _KeyT &k) const {
+        return ConstIterator(this, findUpper(k));
+    }
+
+    // links are kept as offsets throughout, as allocating may move the mapping
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    std::pair<typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator, bool> PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::insert(const _ValT &elem) {
+        uint64_t update[maxHeight];
+        uint64_t found = findPredecessors(elem.first, update);
+        if (found && !comp(elem.first, node(found)->value()->first)) {
+            return std::make_pair(Iterator(this, found), false);
+        }
+
+        // elem may live in the mapping, which allocating can move
+        _ValT copy(elem);
+        int height = randomLevel();
+        uint64_t off = allocNode(height);
+        Header *h = header();
+        for (int l = h->levels; l < height; l++) {
+            update[l] = headOffset;
+        }
+        if (height > h->levels) h->levels = height;
+
+        Node *n = node(off);
+        new (n->value()) _ValT(copy);
+        n->height = height;
+        for (int l = 0; l < height; l++) {
+            n->next[l] = node(update[l])->next[l];
+            node(update[l])->next[l] = off;
+        }
+        n->prev = update[0];
+        if (n->next[0]) {
+            node(n->next[0])->prev = off;
+        } else {
+            h->last = off;
+        }
+        h->count++;
+        return std::make_pair(Iterator(this, off), true);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::erase(Iterator pos) {
+        erase(pos->first);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::erase(const _KeyT &k) {
+        uint64_t update[maxHeight];
+        uint64_t off = findPredecessors(k, update);
+        if (!off || comp(k, node(off)->value()->first)) {
+            throw std::out_of_range("PersistentMap<>::erase : Could not find specified key in map.");
+        }
+
+        Header *h = header();
+        Node *n = node(off);
+        for (int l = 0; l < n->height; l++) {
+            node(update[l])->next[l] = n->next[l];
+        }
+        if (n->next[0]) {
+            node(n->next[0])->prev = n->prev;
+        } else {
+            h->last = (n->prev == headOffset) ? 0 : n->prev;
+        }
+        while (h->levels > 1 && !node(headOffset)->next[h->levels - 1]) {
+            h->levels--;
+        }
+        h->count--;
+        freeNode(off);
+    }
+
+    // keeps the file at its size, as a map that was that big may well be again
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::clear() {
+        Header *h = header();
+        h->used = headOffset + nodeBytes(maxHeight);
+        h->count = 0;
+        h->last = 0;
+        h->levels = 1;
+        std::fill(h->freeLists, h->freeLists + maxHeight, 0);
+        std::fill(node(headOffset)->next, node(headOffset)->next + maxHeight, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::swap(PersistentMap &m) {
+        std::swap(comp, m.comp);
+        std::swap(fd, m.fd);
+        std::swap(writable, m.writable);
+        std::swap(base, m.base);
+        std::swap(mappedBytes, m.mappedBytes);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::sync() {
+        if (writable && ::msync(base, mappedBytes, MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    /*
+     * Readers share the file and a writer has it to itself. An empty file
+     * opened for writing is laid out from scratch; anything else has to
+     * be a persistent map of these exact types.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::openFile(const std::string &path, bool write) {
+        writable = write;
+        fd = ::open(path.c_str(), write ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+        try {
+            if (::flock(fd, (write ? LOCK_EX : LOCK_SH) | LOCK_NB) != 0) {
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0) throw std::system_error(errno, std::generic_category(), path);
+            bool fresh = (st.st_size == 0);
+            if (fresh) {
+                if (!write) throw std::runtime_error("Empty persistent map file: " + path);
+                if (::ftruncate(fd, PERSISTENT_MAP_MIN_BYTES) != 0) throw std::system_error(errno, std::generic_category(), path);
+                st.st_size = PERSISTENT_MAP_MIN_BYTES;
+            }
+            if (size_t(st.st_size) < headOffset + nodeBytes(maxHeight)) {
+                throw std::runtime_error("Not a persistent map: " + path);
+            }
+
+            void *addr = ::mmap(NULL, st.st_size, write ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) throw std::system_error(errno, std::generic_category(), path);
+            base = static_cast<char *>(addr);
+            mappedBytes = st.st_size;
+            if (fresh) format();
+            validate(path);
+        } catch (...) {
+            if (base) ::munmap(base, mappedBytes);
+            ::close(fd);
+            base = NULL;
+            fd = -1;
+            throw;
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::format() {
+        Header *h = header();
+        std::memcpy(h->magic, PERSISTENT_MAP_MAGIC, sizeof(h->magic));
+        h->version = PERSISTENT_MAP_VERSION;
+        h->heightCap = maxHeight;
+        h->keyBytes = sizeof(_KeyT);
+        h->valueBytes = sizeof(_MapT);
+        h->fileBytes = mappedBytes;
+        h->rngState = uint64_t(std::random_device{}()) << 32 ^ std::random_device{}();
+        node(headOffset)->height = maxHeight;
+        node(headOffset)->prev = 0;
+        clear();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::validate(const std::string &path) const {
+        const Header *h = header();
+        if (std::memcmp(h->magic, PERSISTENT_MAP_MAGIC, sizeof(h->magic)) != 0 || h->version != PERSISTENT_MAP_VERSION ||
+            h->fileBytes != mappedBytes || h->used > mappedBytes) {
+            throw std::runtime_error("Not a persistent map: " + path);
+        }
+        if (h->keyBytes != sizeof(_KeyT) || h->valueBytes != sizeof(_MapT) || h->heightCap != uint32_t(maxHeight)) {
+            throw std::runtime_error("Persistent map holds other types: " + path);
+        }
+    }
+
+    // the mapping may move; offsets stay valid
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::grow(uint64_t needed) {
+        size_t bytes = mappedBytes;
+        while (bytes < needed) bytes *= 2;
+        if (::ftruncate(fd, bytes) != 0) throw std::system_error(errno, std::generic_category(), "ftruncate");
+        void *addr = ::mremap(base, mappedBytes, bytes, MREMAP_MAYMOVE);
+        if (addr == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mremap");
+        base = static_cast<char *>(addr);
+        mappedBytes = bytes;
+        header()->fileBytes = bytes;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::checkWritable() const {
+        if (!writable) throw std::logic_error("Persistent map was opened read only");
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    uint64_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::nodeBytes(int height) {
+        uint64_t bytes = offsetof(Node, next) + height * sizeof(uint64_t);
+        return (bytes + alignof(Node) - 1) & ~uint64_t(alignof(Node) - 1);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    uint64_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::allocNode(int height) {
+        uint64_t off = header()->freeLists[height - 1];
+        if (off) {
+            header()->freeLists[height - 1] = node(off)->next[0];
+            return off;
+        }
+        uint64_t bytes = nodeBytes(height);
+        if (header()->used + bytes > mappedBytes) grow(header()->used + bytes);
+        off = header()->used;
+        header()->used += bytes;
+        return off;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::freeNode(uint64_t off) {
+        Node *n = node(off);
+        n->next[0] = header()->freeLists[n->height - 1];
+        header()->freeLists[n->height - 1] = off;
+    }
+
+    // first node not less than k, recording the last node before it on each level
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    uint64_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::findPredecessors(const _KeyT &k, uint64_t *update) const {
+        uint64_t curr = headOffset;
+        for (int l = header()->levels - 1; l >= 0; l--) {
+            uint64_t next;
+            while ((next = node(curr)->next[l]) && comp(node(next)->value()->first, k)) {
+                curr = next;
+            }
+            if (update) update[l] = curr;
+        }
+        return node(curr)->next[0];
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    uint64_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::findNode(const _KeyT &k) const {
+        uint64_t off = findPredecessors(k, NULL);
+        return (off && !comp(k, node(off)->value()->first)) ? off : 0;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    uint64_t PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::findUpper(const _KeyT &k) const {
+        uint64_t curr = headOffset;
+        for (int l = header()->levels - 1; l >= 0; l--) {
+            uint64_t next;
+            while ((next = node(curr)->next[l]) && !comp(k, node(next)->value()->first)) {
+                curr = next;
+            }
+        }
+        return node(curr)->next[0];
+    }
+
+    // the generator state is kept in the file, so reopening carries on the sequence
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    int PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::randomLevel() {
+        uint64_t z = (header()->rngState += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return _LevelsT::height(z ^ (z >> 31));
+    }
+
+    /*
+     * Shared, read only access to a persistent map file. Only lookups and
+     * iteration are offered, so reads never meet a mapping they could not
+     * write to.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>, typename _LevelsT = PromoteHalf<>>
+    class PersistentMapView {
+        typedef PersistentMap<_KeyT, _MapT, _CompT, _LevelsT> _MapType;
+        public:
+            typedef typename _MapType::ConstIterator ConstIterator;
+            typedef typename _MapType::_ValT _ValT;
+
+            explicit PersistentMapView(const std::string &path, const _CompT &c = _CompT()) : map(path, read_only, c) {}
+
+            size_t size() const { return map.size(); }
+            bool empty() const { return map.empty(); }
+
+            ConstIterator begin() const { return map.begin(); }
+            ConstIterator end() const { return map.end(); }
+
+            ConstIterator find(const _KeyT &k) const { return map.find(k); }
+            const _MapT &at(const _KeyT &k) const { return map.at(k); }
+            size_t count(const _KeyT &k) const { return map.count(k); }
+            bool contains(const _KeyT &k) const { return map.contains(k); }
+            ConstIterator lower_bound(const _KeyT &k) const { return map.lower_bound(k); }
+            ConstIterator upper_bound(const _KeyT &k) const { return map.upper_bound(k); }
+
+        private:
+            _MapType map;
+    };
+
+    /*
+     * ITERATOR
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator++() {
+        off = map->node(off)->next[0];
+        return *this;
+    }
+
+    // end() steps back to the last node
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator &PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator--() {
+        off = off ? map->node(off)->prev : map->header()->last;
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator++(int) {
+        Iterator temp = *this;
+        ++*this;
+        return temp;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator PersistentMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator--(int) {
+        Iterator temp = *this;
+        --*this;
+        return temp;
+    }
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdexcept>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+#ifndef __STATIC_MAP_HPP__
+#define __STATIC_MAP_HPP__
+
+namespace cs540 {
+    /*
+     * Fixed table whose contents are known when the program is compiled.
+     * It is built from a literal list by make_static_map(), sorted and
+     * checked for duplicate keys in a constant expression, so a constexpr
+     * table costs nothing at startup and allocates nothing. Lookups are
+     * constexpr too: a constant key folds to its value, and a missing
+     * constant key or a duplicate in the list is a compile error rather
+     * than an exception.
+     *
+     * Keys and values must be literal types (std::string_view rather than
+     * std::string). The sort is an insertion sort, meant for tables of up
+     * to a few thousand entries.
+     */
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT = std::less<_KeyT>>
+    class StaticMap {
+        static_assert(_N > 0, "a static map needs at least one element");
+        struct Order;
+        public:
+            class ConstIterator;
+            typedef ConstIterator Iterator;
+
+            typedef std::pair<_KeyT, _MapT> _ElemT;
+            typedef std::pair<const _KeyT &, const _MapT &> _RefT;
+
+            // constructor
+            constexpr explicit StaticMap(const _ElemT (&)[_N], const _CompT & = _CompT());
+
+            // size
+            constexpr size_t size() const { return _N; }
+            constexpr bool empty() const { return false; }
+
+            // iterators
+            constexpr ConstIterator begin() const { return ConstIterator(this, 0); }
+            constexpr ConstIterator end() const { return ConstIterator(this, _N); }
+
+            // element access
+            constexpr ConstIterator find(const _KeyT &) const;
+            constexpr const _MapT &at(const _KeyT &) const;
+            constexpr size_t count(const _KeyT &) const;
+            constexpr bool contains(const _KeyT &) const;
+            constexpr ConstIterator lower_bound(const _KeyT &) const;
+            constexpr ConstIterator upper_bound(const _KeyT &) const;
+
+            class ConstIterator {
+                public:
+                    // what operator-> points into, since there is no stored pair
+                    struct Arrow {
+                        _RefT ref;
+                        constexpr const _RefT *operator->() const { return &ref; }
+                    };
+
+                    ConstIterator() = delete;
+                    constexpr ConstIterator(const StaticMap *m, size_t i) : map(m), idx(i) {}
+
+                    constexpr ConstIterator &operator++() { ++idx; return *this; }
+                    constexpr ConstIterator &operator--() { --idx; return *this; }
+                    constexpr ConstIterator operator++(int) { ConstIterator temp = *this; ++idx; return temp; }
+                    constexpr ConstIterator operator--(int) { ConstIterator temp = *this; --idx; return temp; }
+
+                    constexpr _RefT operator*() const { return _RefT(map->keys[idx], map->values[idx]); }
+                    constexpr Arrow operator->() const { return Arrow{**this}; }
+
+                    const StaticMap *map;
+                    size_t idx;
+
+                    constexpr bool operator==(const ConstIterator &rhs) const { return idx == rhs.idx && map == rhs.map; }
+                    constexpr bool operator!=(const ConstIterator &rhs) const { return !(*this == rhs); }
+            };
+
+        private:
+            // positions of the list's elements in key order
+            struct Order {
+                size_t idx[_N];
+            };
+
+            template<size_t... _Is> constexpr StaticMap(const _ElemT (&)[_N], const Order &, std::index_sequence<_Is...>, const _CompT &);
+            static constexpr Order sortedOrder(const _ElemT (&)[_N], const _CompT &);
+
+            constexpr size_t lowerBound(const _KeyT &) const;
+            constexpr size_t upperBound(const _KeyT &) const;
+
+            _CompT comp;
+            _KeyT keys[_N];
+            _MapT values[_N];
+    };
+
+    // the list's length is deduced, so only the key and value types are named
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>, size_t _N>
+    constexpr StaticMap<_KeyT, _MapT, _N, _CompT> make_static_map(const std::pair<_KeyT, _MapT> (&elems)[_N], const _CompT &comp = _CompT()) {
+        return StaticMap<_KeyT, _MapT, _N, _CompT>(elems, comp);
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr StaticMap<_KeyT, _MapT, _N, _CompT>::StaticMap(const _ElemT (&elems)[_N], const _CompT &c)
+        : StaticMap(elems, sortedOrder(elems, c), std::make_index_sequence<_N>(), c) {}
+
+    // the elements are placed in key order as they are constructed, so
+    // neither type has to be assignable in a constant expression
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    template <size_t... _Is>
+    constexpr StaticMap<_KeyT, _MapT, _N, _CompT>::StaticMap(const _ElemT (&elems)[_N], const Order &order, std::index_sequence<_Is...>, const _CompT &c)
+        : comp(c), keys{elems[order.idx[_Is]].first...}, values{elems[order.idx[_Is]].second...} {}
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr typename StaticMap<_KeyT, _MapT, _N, _CompT>::Order StaticMap<_KeyT, _MapT, _N, _CompT>::sortedOrder(const _ElemT (&elems)[_N], const _CompT &comp) {
+        Order order{};
+        for (size_t i = 0; i < _N; i++) {
+            size_t j = i;
+            while (j > 0 && comp(elems[i].first, elems[order.idx[j - 1]].first)) {
+                order.idx[j] = order.idx[j - 1];
+                j--;
+            }
+            order.idx[j] = i;
+        }
+        for (size_t i = 1; i < _N; i++) {
+            if (!comp(elems[order.idx[i - 1]].first, elems[order.idx[i]].first)) {
+                throw std::invalid_argument("Duplicate key");
+            }
+        }
+        return order;
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr typename StaticMap<_KeyT, _MapT, _N, _CompT>::ConstIterator StaticMap<_KeyT, _MapT, _N, _CompT>::find(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        if (i != _N && !comp(k, keys[i])) return ConstIterator(this, i);
+        return end();
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr const _MapT &StaticMap<_KeyT, _MapT, _N, _CompT>::at(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        if (i == _N || comp(k, keys[i])) {
+            throw std::out_of_range("const StaticMap<>::at : Could not find specified key in map.");
+        }
+        return values[i];
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr size_t StaticMap<_KeyT, _MapT, _N, _CompT>::count(const _KeyT &k) const {
+        return contains(k) ? 1 : 0;
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr bool StaticMap<_KeyT, _MapT, _N, _CompT>::contains(const _KeyT &k) const {
+        size_t i = lowerBound(k);
+        return i != _N && !comp(k, keys[i]);
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr typename StaticMap<_KeyT, _MapT, _N, _CompT>::ConstIterator StaticMap<_KeyT, _MapT, _N, _CompT>::lower_bound(const _KeyT &k) const {
+        return ConstIterator(this, lowerBound(k));
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr typename StaticMap<_KeyT, _MapT, _N, _CompT>::ConstIterator StaticMap<_KeyT, _MapT, _N, _CompT>::upper_bound(const _KeyT &k) const {
+        return ConstIterator(this, upperBound(k));
+    }
+
+    // binary search whose step is a select rather than a branch; the
+    // answer stays within [base, base + len]
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr size_t StaticMap<_KeyT, _MapT, _N, _CompT>::lowerBound(const _KeyT &k) const {
+        size_t base = 0, len = _N;
+        while (len > 1) {
+            size_t half = len / 2;
+            base = comp(keys[base + half], k) ? base + half : base;
+            len -= half;
+        }
+        return base + comp(keys[base], k);
+    }
+
+    template <typename _KeyT, typename _MapT, size_t _N, typename _CompT>
+    constexpr size_t StaticMap<_KeyT, _MapT, _N, _CompT>::upperBound(const _KeyT &k) const {
+        size_t base = 0, len = _N;
+        while (len > 1) {
+            size_t half = len / 2;
+            base = comp(k, keys[base + half]) ? base : base + half;
+            len -= half;
+        }
+        return base + !comp(k, keys[base]);
+    }
+}
+
+#endif
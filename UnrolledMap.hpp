@@ -0,0 +1,786 @@
+#include <stdexcept>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "Map.hpp"
+
+#ifndef __UNROLLED_MAP_HPP__
+#define __UNROLLED_MAP_HPP__
+
+// elements per block; at most 64 so a block's compare mask fits a word
+#define UNROLLED_BLOCK_SIZE 32
+
+// a block left with fewer elements than this refills from its successor
+#define UNROLLED_BLOCK_MIN (UNROLLED_BLOCK_SIZE / 4)
+
+// the AVX2 compares are built for any x86 target and picked at run time
+// when the compiler was not told the CPU has them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNROLLED_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace cs540 {
+    /*
+     * Search inside a block. Integral keys ordered by std::less keep a
+     * packed, cache line aligned copy of the block's keys, and rank()
+     * counts the ones below a probe with vector compares where the CPU
+     * has them. Other keys binary search the elements themselves.
+     */
+    template <typename _KeyT, typename _CompT>
+    struct BlockSearch {
+        static constexpr bool packed = false;
+    };
+
+    template <typename _KeyT>
+    struct PackedBlockSearch {
+        static constexpr bool packed = true;
+
+        // number of keys[0, n) less than k
+        static int rank(const _KeyT *keys, int n, const _KeyT &k);
+
+#if defined(UNROLLED_AVX2)
+        // rank() for 32 and 64 bit signed keys
+        UNROLLED_AVX2 static int rankAvx2(const _KeyT *keys, int n, const _KeyT &k);
+#endif
+    };
+
+#if defined(UNROLLED_AVX2)
+    // looked up once; __builtin_cpu_init makes it safe before main() too
+    inline bool cpuHasAvx2() {
+        static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return has;
+    }
+#endif
+
+    template <typename _KeyT>
+    struct BlockSearch<_KeyT, typename std::enable_if<std::is_integral<_KeyT>::value, std::less<_KeyT>>::type>
+        : PackedBlockSearch<_KeyT> {};
+
+    template <typename _KeyT>
+    struct BlockSearch<_KeyT, typename std::enable_if<std::is_integral<_KeyT>::value, std::less<>>::type>
+        : PackedBlockSearch<_KeyT> {};
+
+    // the packed keys, empty when the search does not use them
+    template <typename _KeyT, bool _Packed> struct BlockKeys {};
+    template <typename _KeyT> struct BlockKeys<_KeyT, true> {
+        alignas(64) _KeyT keys[UNROLLED_BLOCK_SIZE];
+    };
+
+    /*
+     * Skip list whose level 0 nodes are blocks of up to UNROLLED_BLOCK_SIZE
+     * sorted elements. The towers index blocks by their smallest key, so a
+     * search descends to a block and finishes inside it, and iteration
+     * walks arrays instead of chasing a pointer per element. A full block
+     * splits in half, except that appending past the last element starts
+     * a new block, so ascending inserts leave blocks full. A block that
+     * runs low merges with or borrows from the next one.
+     *
+     * Inserting or erasing may move other elements of the same block or a
+     * neighbouring one, which invalidates iterators to them. Moving an
+     * element must not throw.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT = std::less<_KeyT>, typename _LevelsT = PromoteHalf<>>
+    class UnrolledMap {
+        struct Block;
+        static constexpr int maxHeight = _LevelsT::max_height;
+        public:
+            class Iterator;
+            class ConstIterator;
+
+            typedef std::pair<const _KeyT, _MapT> _ValT;
+
+            // constructors and assignment operator
+            UnrolledMap();
+            UnrolledMap(const UnrolledMap &);
+            UnrolledMap(UnrolledMap &&) noexcept;
+            UnrolledMap &operator=(const UnrolledMap &);
+            UnrolledMap &operator=(UnrolledMap &&) noexcept;
+            UnrolledMap(std::initializer_list<std::pair<const _KeyT, _MapT>>);
+            ~UnrolledMap();
+
+            // size
+            size_t size() const;
+            bool empty() const;
+
+            // iterators
+            Iterator begin();
+            Iterator end();
+            ConstIterator begin() const;
+            ConstIterator end() const;
+
+            // element access
+            Iterator find(const _KeyT &);
+            ConstIterator find(const _KeyT &) const;
+            _MapT &at(const _KeyT &);
+            const _MapT &at(const _KeyT &) const;
+            _MapT &operator[](const _KeyT &);
+            Iterator lower_bound(const _KeyT &);
+            ConstIterator lower_bound(const _KeyT &) const;
+
+            // modifiers
+            std::pair<Iterator, bool> insert(const _ValT &);
+            template<typename... _Args> std::pair<Iterator, bool> try_emplace(const _KeyT &, _Args &&...);
+            void erase(Iterator);
+            void erase(const _KeyT &);
+            void clear();
+            void swap(UnrolledMap &) noexcept;
+
+            class Iterator {
+                public:
+                    Iterator() = delete;
+                    Iterator(Block *b, int i) : block(b), idx(i) {}
+
+                    Iterator &operator++();
+                    Iterator &operator--();
+                    Iterator operator++(int);
+                    Iterator operator--(int);
+
+                    _ValT &operator*() const { return *block->value(idx); }
+                    _ValT *operator->() const { return block->value(idx); }
+
+                    Block *block;
+                    int idx;
+
+                    bool operator==(const Iterator &rhs) const { return block == rhs.block && idx == rhs.idx; }
+                    bool operator!=(const Iterator &rhs) const { return !(*this == rhs); }
+            };
+
+            class ConstIterator : public Iterator {
+                public:
+                    using Iterator::Iterator;
+                    ConstIterator(const Iterator &it) : Iterator(it) {}
+
+                    const _ValT &operator*() const { return *this->block->value(this->idx); }
+                    const _ValT *operator->() const { return this->block->value(this->idx); }
+            };
+
+        private:
+            typedef BlockSearch<_KeyT, _CompT> _SearchT;
+
+            struct Block : BlockKeys<_KeyT, _SearchT::packed> {
+                _ValT *value(int i) { return reinterpret_cast<_ValT *>(&storage[i]); }
+                const _KeyT &key(int i) { return value(i)->first; }
+
+                Block *prev;
+                int height;
+                int count;
+                typename std::aligned_storage<sizeof(_ValT), alignof(_ValT)>::type storage[UNROLLED_BLOCK_SIZE];
+                Block *next[1];
+            };
+
+            // block allocation
+            static Block *allocBlock(int height);
+            static void freeBlock(Block *);
+
+            // element moves inside and between blocks
+            template<typename... _Args> void constructAt(Block *, int, _Args &&...);
+            void destroyAt(Block *, int);
+            void moveRange(Block *, int, Block *);
+
+            // helpers
+            void init();
+            void teardown();
+            void copyFrom(const UnrolledMap &);
+            void linkAfter(Block *, Block *, Block **);
+            void unlinkBlock(Block *);
+            void eraseAt(Block *, int);
+            int randomLevel();
+            int rankIn(Block *, const _KeyT &) const;
+            Block *findBlock(const _KeyT &, Block **) const;
+            Iterator lowerBound(const _KeyT &) const;
+
+            // source of tower heights
+            TowerRandom rng;
+
+            _CompT comp;
+
+            // the sentinels, allocated by the first insert; NULL until
+            // then, and again once the map has been moved from
+            Block *head = NULL;
+            Block *tail = NULL;
+            size_t sz = 0;
+
+            // head links in use: the tallest tower present, or 1 when
+            // empty. Searches start at the top one; the links above it
+            // point at tail until a taller tower claims them
+            int levels = 1;
+    };
+
+    template <typename _KeyT>
+    int PackedBlockSearch<_KeyT>::rank(const _KeyT *keys, int n, const _KeyT &k) {
+        static_assert(UNROLLED_BLOCK_SIZE <= 64 && UNROLLED_BLOCK_SIZE % 8 == 0, "block mask must fit a word");
+        uint64_t live = (n == 64) ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+#if defined(UNROLLED_AVX2)
+        if constexpr (std::is_signed<_KeyT>::value && (sizeof(_KeyT) == 4 || sizeof(_KeyT) == 8)) {
+#if defined(__AVX2__)
+            return rankAvx2(keys, n, k);
+#else
+            if (cpuHasAvx2()) return rankAvx2(keys, n, k);
+#endif
+        }
+#endif
+#if defined(__SSE2__)
+        if constexpr (std::is_signed<_KeyT>::value && sizeof(_KeyT) == 4) {
+            __m128i probe = _mm_set1_epi32(k);
+            uint64_t mask = 0;
+            for (int i = 0; i < n; i += 4) {
+                __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(keys + i));
+                mask |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, probe)))) << i;
+            }
+            return __builtin_popcountll(mask & live);
+        }
+#endif
+        // branch free, which the compiler is free to vectorize itself
+        (void)live;
+        int r = 0;
+        for (int i = 0; i < n; i++) {
+            r += (keys[i] < k);
+        }
+        return r;
+    }
+
+#if defined(UNROLLED_AVX2)
+    template <typename _KeyT>
+    int PackedBlockSearch<_KeyT>::rankAvx2(const _KeyT *keys, int n, const _KeyT &k) {
+        uint64_t live = (n == 64) ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+        uint64_t mask = 0;
+        if constexpr (sizeof(_KeyT) == 4) {
+            __m256i probe = _mm256_set1_epi32(k);
+            for (int i = 0; i < n; i += 8) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+                mask |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(probe, v)))) << i;
+            }
+        } else {
+            __m256i probe = _mm256_set1_epi64x(k);
+            for (int i = 0; i < n; i += 4) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+                mask |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(probe, v)))) << i;
+            }
+        }
+        return __builtin_popcountll(mask & live);
+    }
+#endif
+
+    /*
+     * UNROLLED_MAP
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::UnrolledMap() {
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::UnrolledMap(const UnrolledMap &m) : comp(m.comp) {
+        if (!m.head) return;
+        init();
+        try {
+            copyFrom(m);
+        } catch (...) {
+            teardown();
+            throw;
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::UnrolledMap(UnrolledMap &&m) noexcept : comp(m.comp) {
+        swap(m);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT> &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::operator=(const UnrolledMap &m) {
+        if (this != &m) {
+            UnrolledMap temp(m);
+            swap(temp);
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT> &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::operator=(UnrolledMap &&m) noexcept {
+        if (this != &m) {
+            clear();
+            swap(m);
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::UnrolledMap(std::initializer_list<std::pair<const _KeyT, _MapT>> il) {
+        try {
+            for (auto &elem : il) insert(elem);
+        } catch (...) {
+            teardown();
+            throw;
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::~UnrolledMap() {
+        teardown();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    size_t UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::size() const {
+        return sz;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    bool UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::empty() const {
+        return (sz) ? false : true;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::begin() {
+        return Iterator(head ? head->next[0] : tail, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::end() {
+        return Iterator(tail, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::begin() const {
+        return ConstIterator(head ? head->next[0] : tail, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::end() const {
+        return ConstIterator(tail, 0);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::find(const _KeyT &k) {
+        Iterator it = lowerBound(k);
+        if (it.block != tail && !comp(k, it->first)) return it;
+        return end();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::find(const _KeyT &k) const {
+        Iterator it = lowerBound(k);
+        if (it.block != tail && !comp(k, it->first)) return it;
+        return end();
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    _MapT &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::at(const _KeyT &k) {
+        Iterator search = find(k);
+        if (search != end()) {
+            return search->second;
+        } else {
+            throw std::out_of_range("UnrolledMap<>::at : Could not find specified key in map.");
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    const _MapT &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::at(const _KeyT &k) const {
+        ConstIterator search = find(k);
+        if (search != end()) {
+            return search->second;
+        } else {
+            throw std::out_of_range("const UnrolledMap<>::at : Could not find specified key in map.");
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    _MapT &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::operator[](const _KeyT &k) {
+        return try_emplace(k).first->second;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::lower_bound(const _KeyT &k) {
+        return lowerBound(k);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::ConstIterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::lower_bound(const _KeyT &k) const {
+        return lowerBound(k);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    std::pair<typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator, bool> UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::insert(const _ValT &elem) {
+        return try_emplace(elem.first, elem.second);
+    }
+
+    /*
+     * Finds the block k belongs in: the last one whose smallest key is not
+     * greater than k, or the first block when k is below all of them. A
+     * full block is split first, and the half k falls in takes it.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    template <typename... _Args>
+    std::pair<typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator, bool> UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::try_emplace(const _KeyT &k, _Args &&...args) {
+        if (!head) init();
+        Block *history[maxHeight];
+        Block *b = findBlock(k, history);
+        int pos = 0;
+        if (b == head) {
+            b = head->next[0];
+        } else {
+            pos = rankIn(b, k);
+            if (pos < b->count && !comp(k, b->key(pos))) {
+                return std::pair<Iterator, bool>{Iterator(b, pos), false};
+            }
+        }
+
+        Block *target = b, *fresh = NULL;
+        if (b == tail || b->count == UNROLLED_BLOCK_SIZE) {
+            fresh = allocBlock(randomLevel());
+            target = fresh;
+            if (b != tail) {
+                int keep = (pos == b->count && b->next[0] == tail) ? b->count : b->count / 2;
+                moveRange(b, keep, fresh);
+                if (pos < keep) target = b;
+                else pos -= keep;
+            }
+        }
+
+        try {
+            constructAt(target, pos, std::piecewise_construct,
+                    std::forward_as_tuple(k), std::forward_as_tuple(std::forward<_Args>(args)...));
+        } catch (...) {
+            if (fresh) {
+                if (b != tail) moveRange(fresh, 0, b);
+                freeBlock(fresh);
+            }
+            throw;
+        }
+
+        if (fresh) linkAfter(fresh, (b == tail) ? head : b, history);
+        sz++;
+        return std::pair<Iterator, bool>{Iterator(target, pos), true};
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::erase(Iterator pos) {
+        eraseAt(pos.block, pos.idx);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::erase(const _KeyT &k) {
+        Iterator it = find(k);
+        if (it == end()) {
+            throw std::out_of_range("UnrolledMap<>::erase : Could not find specified key in map.");
+        }
+        eraseAt(it.block, it.idx);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::clear() {
+        if (!head) return;
+        Block *curr = head->next[0];
+        while (curr != tail) {
+            Block *temp = curr;
+            curr = curr->next[0];
+            for (int i = 0; i < temp->count; i++) temp->value(i)->~_ValT();
+            freeBlock(temp);
+        }
+        for (int i = 0; i < maxHeight; i++) {
+            head->next[i] = tail;
+        }
+        tail->prev = head;
+        sz = 0;
+        levels = 1;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::swap(UnrolledMap &m) noexcept {
+        std::swap(comp, m.comp);
+        std::swap(head, m.head);
+        std::swap(tail, m.tail);
+        std::swap(sz, m.sz);
+        std::swap(levels, m.levels);
+    }
+
+    /*
+     * ITERATOR
+     */
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator++() {
+        if (++idx == block->count) {
+            block = block->next[0];
+            idx = 0;
+        }
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator &UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator--() {
+        if (idx == 0) {
+            block = block->prev;
+            idx = block->count;
+        }
+        idx--;
+        return *this;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator++(int) {
+        Iterator temp = *this;
+        ++*this;
+        return temp;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator::operator--(int) {
+        Iterator temp = *this;
+        --*this;
+        return temp;
+    }
+
+    /*
+     * PRIVATE HELPERS
+     */
+
+    // blocks are over-aligned when they carry packed keys
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Block *UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::allocBlock(int height) {
+        size_t bytes = sizeof(Block) + (height - 1) * sizeof(Block *);
+        Block *b = static_cast<Block *>(::operator new(bytes, std::align_val_t(alignof(Block))));
+        if constexpr (_SearchT::packed) {
+            for (int i = 0; i < UNROLLED_BLOCK_SIZE; i++) b->keys[i] = _KeyT();
+        }
+        b->prev = NULL;
+        b->height = height;
+        b->count = 0;
+        return b;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::freeBlock(Block *b) {
+        ::operator delete(b, std::align_val_t(alignof(Block)));
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    template <typename... _Args>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::constructAt(Block *b, int pos, _Args &&...args) {
+        for (int i = b->count; i > pos; i--) {
+            new (b->value(i)) _ValT(std::move(*b->value(i - 1)));
+            b->value(i - 1)->~_ValT();
+        }
+        try {
+            new (b->value(pos)) _ValT(std::forward<_Args>(args)...);
+        } catch (...) {
+            for (int i = pos; i < b->count; i++) {
+                new (b->value(i)) _ValT(std::move(*b->value(i + 1)));
+                b->value(i + 1)->~_ValT();
+            }
+            throw;
+        }
+        if constexpr (_SearchT::packed) {
+            for (int i = b->count; i > pos; i--) b->keys[i] = b->keys[i - 1];
+            b->keys[pos] = b->key(pos);
+        }
+        b->count++;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::destroyAt(Block *b, int pos) {
+        b->value(pos)->~_ValT();
+        for (int i = pos + 1; i < b->count; i++) {
+            new (b->value(i - 1)) _ValT(std::move(*b->value(i)));
+            b->value(i)->~_ValT();
+        }
+        if constexpr (_SearchT::packed) {
+            for (int i = pos + 1; i < b->count; i++) b->keys[i - 1] = b->keys[i];
+        }
+        b->count--;
+    }
+
+    // appends from's elements [start, count) to the end of to
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::moveRange(Block *from, int start, Block *to) {
+        int n = from->count - start;
+        for (int i = 0; i < n; i++) {
+            new (to->value(to->count + i)) _ValT(std::move(*from->value(start + i)));
+            from->value(start + i)->~_ValT();
+            if constexpr (_SearchT::packed) to->keys[to->count + i] = from->keys[start + i];
+        }
+        to->count += n;
+        from->count = start;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::init() {
+        head = allocBlock(maxHeight);
+        try {
+            tail = allocBlock(1);
+        } catch (...) {
+            freeBlock(head);
+            throw;
+        }
+        for (int i = 0; i < maxHeight; i++) {
+            head->next[i] = tail;
+        }
+        tail->next[0] = NULL;
+        tail->prev = head;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::teardown() {
+        if (!head) return;
+        clear();
+        freeBlock(head);
+        freeBlock(tail);
+        head = tail = NULL;
+    }
+
+    // duplicates m block for block, towers included
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::copyFrom(const UnrolledMap &m) {
+        Block *rightMost[maxHeight];
+        for (int i = 0; i < maxHeight; i++) rightMost[i] = head;
+
+        for (Block *from = m.head->next[0]; from != m.tail; from = from->next[0]) {
+            Block *b = allocBlock(from->height);
+            try {
+                for (int i = 0; i < from->count; i++) {
+                    new (b->value(i)) _ValT(*from->value(i));
+                    if constexpr (_SearchT::packed) b->keys[i] = from->keys[i];
+                    b->count++;
+                }
+            } catch (...) {
+                for (int i = 0; i < b->count; i++) b->value(i)->~_ValT();
+                freeBlock(b);
+                throw;
+            }
+
+            linkAfter(b, rightMost[0], rightMost);
+            for (int i = 0; i < b->height; i++) rightMost[i] = b;
+            sz += b->count;
+        }
+    }
+
+    // links b directly after pos; history holds b's predecessors on the
+    // levels in use that pos does not reach, and above those it is head
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::linkAfter(Block *b, Block *pos, Block **history) {
+        for (int i = 0; i < b->height; i++) {
+            Block *pred = (i < pos->height) ? pos : (i < levels) ? history[i] : head;
+            b->next[i] = pred->next[i];
+            pred->next[i] = b;
+        }
+        b->prev = pos;
+        b->next[0]->prev = b;
+        if (b->height > levels) levels = b->height;
+    }
+
+    // must be called while b still holds its smallest key
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::unlinkBlock(Block *b) {
+        const _KeyT &k = b->key(0);
+        Block *curr = head;
+        for (int i = levels - 1; i >= 0; i--) {
+            while (curr->next[i] != tail && comp(curr->next[i]->key(0), k)) {
+                curr = curr->next[i];
+            }
+            if (i < b->height) curr->next[i] = b->next[i];
+        }
+        b->next[0]->prev = b->prev;
+        while (levels > 1 && head->next[levels - 1] == tail) levels--;
+    }
+
+    /*
+     * A block that empties is unlinked. One that falls below the minimum
+     * takes the next block in whole if that fits, or else borrows enough
+     * of it to even the two out.
+     */
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::eraseAt(Block *b, int pos) {
+        sz--;
+        if (b->count == 1) {
+            unlinkBlock(b);
+            b->value(0)->~_ValT();
+            freeBlock(b);
+            return;
+        }
+
+        destroyAt(b, pos);
+        Block *n = b->next[0];
+        if (b->count >= UNROLLED_BLOCK_MIN || n == tail) return;
+
+        if (b->count + n->count <= UNROLLED_BLOCK_SIZE) {
+            unlinkBlock(n);
+            moveRange(n, 0, b);
+            freeBlock(n);
+        } else {
+            int take = (n->count - b->count) / 2;
+            for (int i = 0; i < take; i++) {
+                new (b->value(b->count + i)) _ValT(std::move(*n->value(i)));
+                n->value(i)->~_ValT();
+                if constexpr (_SearchT::packed) b->keys[b->count + i] = n->keys[i];
+            }
+            for (int i = take; i < n->count; i++) {
+                new (n->value(i - take)) _ValT(std::move(*n->value(i)));
+                n->value(i)->~_ValT();
+                if constexpr (_SearchT::packed) n->keys[i - take] = n->keys[i];
+            }
+            b->count += take;
+            n->count -= take;
+        }
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    int UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::randomLevel() {
+        return _LevelsT::height(rng.next());
+    }
+
+    // number of elements in b with keys less than k
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    int UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::rankIn(Block *b, const _KeyT &k) const {
+        if constexpr (_SearchT::packed) {
+            return _SearchT::rank(b->keys, b->count, k);
+        } else {
+            int lo = 0, hi = b->count;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (comp(b->key(mid), k)) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+    }
+
+    // last block whose smallest key is not greater than k, head if none;
+    // fills history (if given) with the same on every level in use
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Block *UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::findBlock(const _KeyT &k, Block **history) const {
+        Block *curr = head;
+        for (int i = levels - 1; i >= 0; i--) {
+            while (curr->next[i] != tail && !comp(k, curr->next[i]->key(0))) {
+                curr = curr->next[i];
+            }
+            if (history) history[i] = curr;
+        }
+        return curr;
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    typename UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::Iterator UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT>::lowerBound(const _KeyT &k) const {
+        if (!head) return Iterator(tail, 0);
+        Block *b = findBlock(k, NULL);
+        if (b == head) return Iterator(head->next[0], 0);
+
+        int pos = rankIn(b, k);
+        if (pos == b->count) return Iterator(b->next[0], 0);
+        return Iterator(b, pos);
+    }
+
+    template <typename _KeyT, typename _MapT, typename _CompT, typename _LevelsT>
+    void swap(UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT> &a, UnrolledMap<_KeyT, _MapT, _CompT, _LevelsT> &b) noexcept {
+        a.swap(b);
+    }
+}
+
+#endif
@@ -24,9 +24,7 @@ class MyKeyType {
             return this->val < other.val;
         }
 
-        bool operator==(const MyKeyType &other) const {
-            return this->val == other.val;
-        }
+        // no operator==, keys are only ever ordered
 };
 
 // same as keytype except no operator<
@@ -0,0 +1,113 @@
+#include "ConcurrentMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cassert>
+
+#define THREADS 8
+
+void single_threaded() {
+    cs540::ConcurrentMap<int, std::string> m;
+    assert(m.empty());
+    assert(m.insert({3, "three"}));
+    assert(m.insert({1, "one"}));
+    assert(m.emplace(2, 3, 'x'));
+    assert(!m.insert({3, "again"})); // keys are unique
+    assert(m.size() == 3);
+
+    std::string s;
+    assert(m.find(2, s) && s == "xxx");
+    assert(m.at(3) == "three");
+    bool thrown = false;
+    try {
+        m.at(10000);
+    } catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    int prev = 0;
+    m.for_each([&](const std::pair<const int, std::string> &p) {
+        assert(prev < p.first);
+        prev = p.first;
+    });
+
+    assert(m.erase(1));
+    assert(!m.erase(1));
+    assert(!m.contains(1));
+    assert(m.size() == 2);
+}
+
+// every thread owns a slice of the key space, so the final contents are known
+void disjoint_writers(int per_thread) {
+    cs540::ConcurrentMap<int, int> m;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&m, t, per_thread]() {
+            int done = 0;
+            for (int i = 0; i < per_thread; i++) {
+                done += m.insert({i * THREADS + t, t});
+            }
+            for (int i = 0; i < per_thread; i += 2) {
+                done -= m.erase(i * THREADS + t);
+            }
+            assert(done == per_thread / 2);
+        });
+    }
+    for (auto &th : threads) th.join();
+
+    assert(m.size() == size_t(THREADS * (per_thread / 2)));
+    for (int k = 0; k < THREADS * per_thread; k++) {
+        int v;
+        bool odd = (k / THREADS) % 2;
+        assert(m.find(k, v) == odd);
+        if (odd) assert(v == k % THREADS);
+    }
+}
+
+// all threads fight over a few keys; each successful insert and erase is
+// counted, and the difference has to be what is left in the map
+void contended(int ops) {
+    cs540::ConcurrentMap<int, int> m;
+    std::atomic<long> inserted{0}, erased{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            unsigned int seed = t * 7919 + 1;
+            for (int i = 0; i < ops; i++) {
+                seed = seed * 1103515245 + 12345;
+                int k = (seed >> 16) % 64;
+                int v;
+                switch ((seed >> 8) % 3) {
+                    case 0:
+                        if (m.insert({k, k})) inserted++;
+                        break;
+                    case 1:
+                        if (m.erase(k)) erased++;
+                        break;
+                    default:
+                        if (m.find(k, v)) assert(v == k);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+
+    size_t count = 0;
+    m.for_each([&](const std::pair<const int, int> &) { count++; });
+    assert(count == size_t(inserted - erased));
+    assert(m.size() == count);
+}
+
+int main () {
+    single_threaded();
+    disjoint_writers(20000);
+    contended(200000);
+
+    std::cout << "ConcurrentMap tests passed" << std::endl;
+    return 0;
+}
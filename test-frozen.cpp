@@ -0,0 +1,113 @@
+#include "FrozenMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <random>
+#include <vector>
+#include <map>
+#include <cassert>
+
+// every size up to a few full levels of the layout, frozen from a Map and
+// probed against std::map on and between the keys
+template <typename K, typename F>
+void against_std_map(F makeKey, int maxSize) {
+    for (int n = 0; n <= maxSize; n++) {
+        cs540::Map<K, int> m;
+        std::map<K, int> s;
+        for (int i = 0; i < n; i++) {
+            m.insert({makeKey(2 * i + 1), i});
+            s.insert({makeKey(2 * i + 1), i});
+        }
+        const cs540::FrozenMap<K, int> f(m);
+        assert(f.size() == s.size() && f.empty() == s.empty());
+
+        auto it = f.begin();
+        for (auto &e : s) {
+            assert(it != f.end() && it->first == e.first && it->second == e.second);
+            ++it;
+        }
+        assert(it == f.end());
+        for (auto rit = s.rbegin(); rit != s.rend(); ++rit) {
+            --it;
+            assert((*it).first == rit->first);
+        }
+        assert(it == f.begin());
+
+        for (int i = 0; i <= 2 * n + 1; i++) {
+            K k = makeKey(i);
+            assert(f.contains(k) == (s.count(k) == 1) && f.count(k) == s.count(k));
+            auto fi = f.find(k);
+            assert((fi == f.end()) == !s.count(k));
+            if (fi != f.end()) assert(fi->second == s.at(k) && f.at(k) == s.at(k));
+            auto lb = f.lower_bound(k);
+            auto slb = s.lower_bound(k);
+            assert((lb == f.end()) == (slb == s.end()));
+            if (slb != s.end()) assert(lb->first == slb->first);
+            auto ub = f.upper_bound(k);
+            auto sub = s.upper_bound(k);
+            assert((ub == f.end()) == (sub == s.end()));
+            if (sub != s.end()) assert(ub->first == sub->first);
+        }
+    }
+}
+
+void construction() {
+    // unsorted input keeps the first of equal keys, like inserting into a Map
+    cs540::FrozenMap<int, std::string> f{{3, "three"}, {1, "one"}, {3, "again"}, {2, "two"}};
+    assert(f.size() == 3 && f.at(3) == "three" && f.begin()->second == "one");
+
+    bool thrown = false;
+    try {
+        f.at(10000);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::vector<std::pair<int, std::string>> sorted;
+    for (int i = 0; i < 1000; i++) {
+        sorted.push_back({i * 3, std::to_string(i)});
+    }
+    cs540::FrozenMap<int, std::string> g(cs540::sorted_unique, sorted.begin(), sorted.end());
+    assert(g.size() == 1000 && g.at(2997) == "999" && !g.contains(2998));
+
+    // copies and moves carry the whole table
+    cs540::FrozenMap<int, std::string> h(g);
+    assert(h.size() == 1000 && h.at(300) == "100");
+    f = std::move(h);
+    assert(f.size() == 1000 && h.empty() && h.begin() == h.end());
+    h = f;
+    assert(h.size() == 1000 && h.find(3) != h.end() && h.find(3)->second == "1");
+
+    // values are the map's own, not copies of one another
+    cs540::FrozenMap<int, std::vector<int>> v{{1, {1, 2, 3}}, {2, {}}};
+    assert(v.at(1).size() == 3 && v.at(2).empty());
+}
+
+void random_lookups(int n, int probes) {
+    std::default_random_engine gen(11);
+    std::map<long, long> s;
+    while (s.size() < size_t(n)) {
+        long k = gen();
+        s[k] = k / 3;
+    }
+    cs540::FrozenMap<long, long> f(s.begin(), s.end());
+    assert(f.size() == s.size());
+    for (int i = 0; i < probes; i++) {
+        long k = (i % 2) ? std::next(s.begin(), gen() % n)->first : long(gen());
+        auto it = f.find(k);
+        assert((it == f.end()) == !s.count(k));
+        if (it != f.end()) assert(it->second == k / 3);
+    }
+}
+
+int main () {
+    construction();
+    against_std_map<int>([](int x) { return x; }, 300);
+    against_std_map<std::string>([](int x) { return std::to_string(100000 + x); }, 70);
+    random_lookups(100000, 20000);
+
+    std::cout << "FrozenMap tests passed" << std::endl;
+    return 0;
+}
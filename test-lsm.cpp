@@ -0,0 +1,129 @@
+#include "LsmMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <filesystem>
+#include <random>
+#include <map>
+#include <cassert>
+
+#define DIR "test-lsm.db"
+
+// the callback looks each element up again, as for_each lets it
+template <typename M>
+void check(const M &m, const std::map<int, std::string> &s) {
+    auto it = s.begin();
+    m.for_each([&](const std::pair<const int, std::string> &e) {
+        assert(it != s.end() && e.first == it->first && e.second == it->second);
+        assert(m.contains(e.first) && m.at(e.first) == e.second);
+        ++it;
+    });
+    assert(it == s.end());
+}
+
+// a small memtable, so that the data lives mostly in runs that keep
+// being flushed and merged underneath the checks
+void against_std_map(int ops) {
+    std::default_random_engine gen(5);
+    std::map<int, std::string> s;
+    for (int round = 0; round < 3; round++) {
+        cs540::LsmMap<int, std::string> m(DIR, 500);
+        check(m, s);
+        for (int i = 0; i < ops; i++) {
+            int k = gen() % 5000;
+            switch (gen() % 4) {
+                case 0:
+                case 1: {
+                    std::string v = std::to_string(i) + std::string(i % 7, 'x');
+                    m.insert_or_assign(k, v);
+                    s[k] = v;
+                    break;
+                }
+                case 2:
+                    m.erase(k);
+                    s.erase(k);
+                    break;
+                default:
+                    std::string v;
+                    bool found = m.find(k, v);
+                    assert(found == (s.count(k) == 1) && m.contains(k) == found);
+                    if (found) assert(v == s.at(k) && m.at(k) == v);
+            }
+        }
+        check(m, s);
+        // a few tiers of fewer than LSM_TIER_RUNS runs, plus any not yet merged
+        assert(m.run_count() <= 3 * LSM_TIER_RUNS);
+        if (round == 1) {
+            m.compact();
+            assert(m.run_count() == 1);
+            check(m, s);
+        }
+        m.flush();
+    }
+}
+
+void basics() {
+    cs540::LsmMap<int, std::string> m(DIR);
+    m.insert_or_assign(1, "one");
+    m.insert_or_assign(1, "uno");
+    m.erase(2);
+    assert(m.at(1) == "uno" && !m.contains(2));
+
+    bool thrown = false;
+    try {
+        m.at(2);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // an erase in the memtable hides a value in a run
+    m.insert_or_assign(3, "three");
+    m.flush();
+    m.erase(3);
+    assert(!m.contains(3));
+    m.flush();
+    m.compact();
+    assert(!m.contains(3) && m.at(1) == "uno" && m.run_count() == 1);
+}
+
+// compact() called while a tiered merge is still being written
+void compact_during_merge() {
+    cs540::LsmMap<int, std::string> m(DIR, 100);
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 100 * LSM_TIER_RUNS; i++) {
+            m.insert_or_assign(i, std::to_string(round));
+        }
+        m.erase(round);
+        m.compact();
+        assert(m.run_count() == 1 && !m.contains(round) && m.at(99) == std::to_string(round));
+    }
+}
+
+int main () {
+    std::filesystem::remove_all(DIR);
+    basics();
+
+    // an input that a merge did not get to remove is dropped on open
+    std::filesystem::copy_file(DIR "/00000000000000000002.run", DIR "/00000000000000000001.run");
+    {
+        cs540::LsmMap<int, std::string> m(DIR);
+        assert(m.run_count() == 1 && m.at(1) == "uno");
+    }
+    std::filesystem::remove_all(DIR);
+    compact_during_merge();
+    std::filesystem::remove_all(DIR);
+    against_std_map(60000);
+
+    // leftovers of an interrupted flush are cleared away on open
+    std::fclose(std::fopen(DIR "/00000000000000000099.run.tmp", "w"));
+    {
+        cs540::LsmMap<int, std::string> m(DIR);
+        assert(!std::filesystem::exists(DIR "/00000000000000000099.run.tmp"));
+    }
+    std::filesystem::remove_all(DIR);
+
+    std::cout << "LsmMap tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "PersistentMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <random>
+#include <map>
+#include <utility>
+#include <type_traits>
+#include <cstdio>
+#include <cassert>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PATH "test-persistent.map"
+
+template <typename M>
+void check(const M &m, const std::map<long, int> &s) {
+    assert(m.size() == s.size());
+    auto it = m.begin();
+    for (auto &e : s) {
+        assert(it != m.end() && it->first == e.first && it->second == e.second);
+        ++it;
+    }
+    assert(it == m.end());
+    if (!s.empty()) {
+        --it;
+        assert(it->first == s.rbegin()->first);
+    }
+}
+
+// random inserts and erases, enough to grow the file several times and
+// reuse erased nodes, checked against std::map across reopens
+void against_std_map(int ops) {
+    std::default_random_engine gen(3);
+    std::map<long, int> s;
+    for (int round = 0; round < 3; round++) {
+        cs540::PersistentMap<long, int> m(PATH);
+        check(m, s);
+        for (int i = 0; i < ops; i++) {
+            long k = gen() % 20000;
+            switch (gen() % 4) {
+                case 0:
+                case 1:
+                    assert(m.insert({k, i}).second == s.insert({k, i}).second);
+                    break;
+                case 2:
+                    if (s.erase(k)) m.erase(k);
+                    break;
+                default:
+                    assert(m.contains(k) == (s.count(k) == 1));
+                    auto lb = m.lower_bound(k);
+                    auto slb = s.lower_bound(k);
+                    assert((lb == m.end()) == (slb == s.end()));
+                    if (slb != s.end()) assert(lb->first == slb->first);
+                    auto ub = m.upper_bound(k);
+                    auto sub = s.upper_bound(k);
+                    assert((ub == m.end()) == (sub == s.end()));
+                    if (sub != s.end()) assert(ub->first == sub->first);
+            }
+        }
+        check(m, s);
+        m.sync();
+    }
+}
+
+void sharing() {
+    {
+        cs540::PersistentMap<long, int> m(PATH);
+        m.clear();
+        for (int i = 0; i < 1000; i++) {
+            m[i] = i * i;
+        }
+        m.erase(m.find(0));
+    }
+
+    // readers share the file with each other, but not with a writer
+    cs540::PersistentMapView<long, int> r1(PATH);
+    const cs540::PersistentMapView<long, int> r2(PATH);
+    assert(r1.size() == 999 && r2.at(30) == 900 && !r2.contains(0));
+    bool thrown = false;
+    try {
+        cs540::PersistentMap<long, int> w(PATH);
+    } catch (std::system_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // a view reads like any map, and only ever hands out const access
+    long sum = 0;
+    for (auto &e : r1) {
+        sum += e.second;
+    }
+    static_assert(std::is_same<decltype((r1.find(30)->second)), const int &>::value, "views are read only");
+    assert(sum == 332833500 && r1.find(30)->second == 900 && r1.lower_bound(31)->first == 31);
+    auto last = r1.end();
+    last--;
+    assert(r1.upper_bound(31)->first == 32 && last->first == 999 && (--last)->first == 998);
+
+    // another process maps the same file
+    pid_t pid = fork();
+    if (pid == 0) {
+        const cs540::PersistentMapView<long, int> child(PATH);
+        _exit(child.size() == 999 && child.at(999) == 998001 ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // a file of other types is refused
+    thrown = false;
+    try {
+        cs540::PersistentMapView<int, int> other(PATH);
+    } catch (std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // moving hands over the mapping
+    cs540::PersistentMapView<long, int> moved(std::move(r1));
+    assert(moved.size() == 999 && moved.begin()->first == 1);
+}
+
+int main () {
+    std::remove(PATH);
+    against_std_map(100000);
+    sharing();
+    std::remove(PATH);
+
+    std::cout << "PersistentMap tests passed" << std::endl;
+    return 0;
+}
@@ -1,4 +1,7 @@
 #include "Map.hpp"
+#include "UnrolledMap.hpp"
+#include "FrozenMap.hpp"
+#include "PersistentMap.hpp"
 #include <chrono>
 #include <random>
 #include <iostream>
@@ -35,6 +38,12 @@ namespace cs540 {
       }
     }
     
+    // std::map builds from sorted input in linear time on its own
+    template <typename It>
+    StdMapWrapper(sorted_unique_t, It first, It last)
+      : m_map(first, last)
+    {}
+    
     StdMapWrapper(StdMapWrapper &&other)
       : m_map(std::move(other.m_map))
     {}
@@ -133,6 +142,10 @@ namespace cs540 {
       return m_map.insert(std::move(value)).first;
     }
     
+    Iterator insert(Iterator hint, const value_type &value) {
+      return m_map.insert(hint, value);
+    }
+    
     void erase(const K &k) {
       m_map.erase(k);
     }
@@ -159,6 +172,20 @@ namespace cs540 {
       return m_map.find(k);
     }
     
+    // no batch lookup in std::map, so one find per key
+    template <typename KeyIt, typename OutIt>
+    OutIt find_batch(KeyIt first, KeyIt last, OutIt out) {
+      for(; first != last; ++first) {
+        *out++ = m_map.find(*first);
+      }
+      return out;
+    }
+    
+    template <typename KeyIt, typename OutIt>
+    OutIt find_many(KeyIt first, KeyIt last, OutIt out) {
+      return find_batch(first, last, out);
+    }
+    
     V &operator[](const K &k) {
       return m_map[k];
     }
@@ -261,6 +288,57 @@ T descendingInsert(int count, bool print = true) {
   return map;
 }
 
+template <typename T>
+void hintedAscendingInsert(int count) {
+  using namespace std::chrono;
+  TimePoint start, end;
+  start = system_clock::now();
+  T map;
+  for(int i = 0; i < count; i++) {
+    map.insert(map.end(), std::pair<int, int>(i,i));
+  }
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  std::cout << "Inserting " << count << " elements in aescending order with end() as the hint took " << elapsed.count() << " milliseconds" << std::endl;
+}
+
+template <typename T>
+void hintedDescendingInsert(int count) {
+  using namespace std::chrono;
+  TimePoint start, end;
+  start = system_clock::now();
+  T map;
+  auto hint = map.end();
+  for(int i = count; i > 0; i--) {
+    hint = map.insert(hint, std::pair<int, int>(i,i));
+  }
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  std::cout << "Inserting " << count << " elements in descending order with the previous insert as the hint took " << elapsed.count() << " milliseconds" << std::endl;
+}
+
+template <typename T>
+void bulkLoadTest(int count) {
+  using namespace std::chrono;
+  std::vector<std::pair<int, int>> sorted;
+  for(int i = 0; i < count; i++) {
+    sorted.push_back(std::pair<int, int>(i,i));
+  }
+  
+  TimePoint start, end;
+  start = system_clock::now();
+  T map(cs540::sorted_unique, sorted.begin(), sorted.end());
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  std::cout << "Bulk loading " << map.size() << " sorted elements took " << elapsed.count() << " milliseconds" << std::endl;
+}
+
 template <typename T>
 void deleteTest() {
   using namespace std::chrono;
@@ -430,6 +508,64 @@ void findTest() {
   
 }
 
+template <typename T>
+void batchFindTest(int count, int probes) {
+  using namespace std::chrono;
+  T m = ascendingInsert<T>(count, false);
+  
+  std::vector<int> toFind;
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0,count-1);
+  while(toFind.size() < size_t(probes)) {
+    toFind.push_back(distribution(generator));
+  }
+  std::vector<typename T::Iterator> found;
+  found.reserve(probes);
+  
+  TimePoint start, end;
+  start = system_clock::now();
+  m.find_batch(toFind.begin(), toFind.end(), std::back_inserter(found));
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  long sum = 0;
+  for(auto it : found) {
+    sum += it->second;
+  }
+  
+  std::cout << "Batch finding " << probes << " random elements from a map of size " << m.size() << " took " << elapsed.count() << " milliseconds (checksum " << sum << ")" << std::endl;
+}
+
+template <typename T>
+void findManyTest(int count, int probes) {
+  using namespace std::chrono;
+  T m = ascendingInsert<T>(count, false);
+  
+  std::vector<int> toFind;
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0,count-1);
+  while(toFind.size() < size_t(probes)) {
+    toFind.push_back(distribution(generator));
+  }
+  std::vector<typename T::Iterator> found;
+  found.reserve(probes);
+  
+  TimePoint start, end;
+  start = system_clock::now();
+  m.find_many(toFind.begin(), toFind.end(), std::back_inserter(found));
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  long sum = 0;
+  for(auto it : found) {
+    sum += it->second;
+  }
+  
+  std::cout << "Interleaved finding " << probes << " random elements from a map of size " << m.size() << " took " << elapsed.count() << " milliseconds (checksum " << sum << ")" << std::endl;
+}
+
 template <typename T>
 void iterationTest(int count) {
   using namespace std::chrono;
@@ -468,6 +604,165 @@ void copyTest(int count) {
 }
 
 
+// Many short-lived maps: construction and teardown dominate.
+template <typename T>
+void smallMapsTest(int maps, int elements) {
+  using namespace std::chrono;
+  TimePoint start, end;
+  long sum = 0;
+
+  start = system_clock::now();
+  for(int i = 0; i < maps; i++) {
+    T map;
+    for(int j = 0; j < elements; j++) {
+      map.insert(std::pair<int, int>(j, i));
+    }
+    sum += map.size();
+  }
+  end = system_clock::now();
+
+  Milli elapsed = end - start;
+
+  std::cout << "Building and destroying " << maps << " maps of " << elements << " elements took " << elapsed.count() << " milliseconds (checksum " << sum << ")" << std::endl;
+}
+
+// Random finds into a table that is no longer modified.
+template <typename T>
+void readOnlyFindTest(const T &map, int probes) {
+  using namespace std::chrono;
+  std::vector<int> toFind;
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0,map.size()-1);
+  while(toFind.size() < size_t(probes)) {
+    toFind.push_back(distribution(generator));
+  }
+
+  TimePoint start, end;
+  long sum = 0;
+  start = system_clock::now();
+  for(const int e : toFind) {
+    sum += map.find(e)->second;
+  }
+  end = system_clock::now();
+
+  Milli elapsed = end - start;
+
+  std::cout << "Finding " << probes << " random elements from a read only map of size " << map.size() << " took " << elapsed.count() << " milliseconds (checksum " << sum << ")" << std::endl;
+}
+
+// Saving a map to a file and restoring it, against rebuilding it from its elements.
+template <typename T>
+void snapshotTest(int count) {
+  using namespace std::chrono;
+  TimePoint start, end;
+  T map = ascendingInsert<T>(count, false);
+
+  start = system_clock::now();
+  map.save("scaling-snapshot.bin");
+  end = system_clock::now();
+  Milli saved = end - start;
+
+  start = system_clock::now();
+  T loaded;
+  loaded.load("scaling-snapshot.bin");
+  end = system_clock::now();
+  Milli restored = end - start;
+
+  start = system_clock::now();
+  T rebuilt;
+  for(auto &e : map) {
+    rebuilt.insert(e);
+  }
+  end = system_clock::now();
+  Milli reinserted = end - start;
+  std::remove("scaling-snapshot.bin");
+
+  assert(loaded.size() == map.size() && rebuilt.size() == map.size());
+  std::cout << "Saving a map of size " << map.size() << " took " << saved.count() << " milliseconds, loading it " << restored.count() << " milliseconds and reinserting it " << reinserted.count() << " milliseconds" << std::endl;
+}
+
+// Reopening a map kept in a file, which maps it again instead of rebuilding it.
+void persistentReopenTest(int count) {
+  using namespace std::chrono;
+  TimePoint start, end;
+  std::remove("scaling-persistent.map");
+  {
+    cs540::PersistentMap<int,int> map("scaling-persistent.map");
+    for(int i = 0; i < count; i++) {
+      map.insert(std::pair<int, int>(i, i));
+    }
+  }
+
+  start = system_clock::now();
+  const cs540::PersistentMapView<int,int> map("scaling-persistent.map");
+  long sum = map.at(count / 2);
+  end = system_clock::now();
+  Milli elapsed = end - start;
+  std::remove("scaling-persistent.map");
+
+  std::cout << "Reopening a persistent map of size " << map.size() << " and finding one element took " << elapsed.count() << " milliseconds (checksum " << sum << ")" << std::endl;
+}
+
+// Positional access: Map can jump straight to an index, anything else has to walk.
+template <typename T>
+typename T::Iterator nthElement(T &map, int i) {
+  auto it = map.begin();
+  while(i--) ++it;
+  return it;
+}
+
+template <typename K, typename V>
+typename cs540::Map<K,V>::Iterator nthElement(cs540::Map<K,V> &map, int i) {
+  return map.nth(i);
+}
+
+template <typename T>
+void indexTest(int count) {
+  using namespace std::chrono;
+  T m = ascendingInsert<T>(count, false);
+  
+  std::vector<int> toIndex;
+  {
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> distribution(0,count-1);
+    while(toIndex.size() < 1000) {
+      toIndex.push_back(distribution(generator));
+    }
+  }
+  
+  TimePoint start, end;
+  
+  start = system_clock::now();
+  long sum = 0;
+  for(const int i : toIndex) {
+    auto it = nthElement(m, i);
+    assert((*it).first == i);
+    sum += (*it).second;
+  }
+  end = system_clock::now();
+  
+  Milli elapsed = end - start;
+  
+  std::cout << "Indexing 1000 positions in a map of size " << m.size() << " took " << elapsed.count() << " milliseconds" << std::endl;
+}
+
+template <typename T>
+void copyAssignTest(int count) {
+  using namespace std::chrono;
+  T m = ascendingInsert<T>(count,false);
+  T m2 = descendingInsert<T>(count,false);
+  
+  TimePoint start, end;
+  
+  start = system_clock::now();
+  m2 = m;
+  end = system_clock::now();
+
+  Milli elapsed = end - start;
+  
+  std::cout << "Copy assignment of a map of size " << m.size() << " over one of the same size took " << elapsed.count() << " milliseconds" << std::endl;
+}
+
 /*
   #include <assert.h>
 
@@ -515,6 +810,9 @@ int main() {
   
   const char *w = demangle(typeid(cs540::StdMapWrapper<int,int>));
   const char *m = demangle(typeid(cs540::Map<int,int>));
+  const char *u = demangle(typeid(cs540::UnrolledMap<int,int>));
+  const char *f = demangle(typeid(cs540::FrozenMap<int,int>));
+  const char *p = demangle(typeid(cs540::PersistentMap<int,int>));
   
   {
     dispTestName("Ascending insert", m);
@@ -546,6 +844,28 @@ int main() {
     descendingInsert<cs540::StdMapWrapper<int,int>>(10000000);
   }
   
+  {
+    dispTestName("Hinted insert", m);
+    hintedAscendingInsert<cs540::Map<int,int>>(1000000);
+    hintedAscendingInsert<cs540::Map<int,int>>(10000000);
+    hintedDescendingInsert<cs540::Map<int,int>>(1000000);
+    hintedDescendingInsert<cs540::Map<int,int>>(10000000);
+    dispTestName("Hinted insert", w);
+    hintedAscendingInsert<cs540::StdMapWrapper<int,int>>(1000000);
+    hintedAscendingInsert<cs540::StdMapWrapper<int,int>>(10000000);
+    hintedDescendingInsert<cs540::StdMapWrapper<int,int>>(1000000);
+    hintedDescendingInsert<cs540::StdMapWrapper<int,int>>(10000000);
+  }
+  
+  {
+    dispTestName("Bulk load", m);
+    bulkLoadTest<cs540::Map<int,int>>(1000000);
+    bulkLoadTest<cs540::Map<int,int>>(10000000);
+    dispTestName("Bulk load", w);
+    bulkLoadTest<cs540::StdMapWrapper<int,int>>(1000000);
+    bulkLoadTest<cs540::StdMapWrapper<int,int>>(10000000);
+  }
+  
   {
     dispTestName("Delete test", m);
     deleteTest<cs540::Map<int,int>>();
@@ -560,6 +880,30 @@ int main() {
     findTest<cs540::StdMapWrapper<int,int>>();
   }
   
+  {
+    dispTestName("Batch find test", m);
+    batchFindTest<cs540::Map<int,int>>(100000, 10000);
+    batchFindTest<cs540::Map<int,int>>(1000000, 10000);
+    batchFindTest<cs540::Map<int,int>>(10000000, 10000);
+    batchFindTest<cs540::Map<int,int>>(10000000, 1000000);
+    dispTestName("Batch find test", w);
+    batchFindTest<cs540::StdMapWrapper<int,int>>(100000, 10000);
+    batchFindTest<cs540::StdMapWrapper<int,int>>(1000000, 10000);
+    batchFindTest<cs540::StdMapWrapper<int,int>>(10000000, 10000);
+    batchFindTest<cs540::StdMapWrapper<int,int>>(10000000, 1000000);
+  }
+  
+  {
+    dispTestName("Interleaved find test", m);
+    findManyTest<cs540::Map<int,int>>(100000, 10000);
+    findManyTest<cs540::Map<int,int>>(1000000, 10000);
+    findManyTest<cs540::Map<int,int>>(10000000, 10000);
+    dispTestName("Interleaved find test", w);
+    findManyTest<cs540::StdMapWrapper<int,int>>(100000, 10000);
+    findManyTest<cs540::StdMapWrapper<int,int>>(1000000, 10000);
+    findManyTest<cs540::StdMapWrapper<int,int>>(10000000, 10000);
+  }
+  
   /*
     Remember that some of these maps get quite large - iteration times may be affected by things other than the scaling of your algorithm.
     How do the many levels of the memory heirarchy in a computer relate?
@@ -600,6 +944,24 @@ int main() {
 #endif
   }
   
+  {
+    //The unrolled variant against the same insert, find, delete and iteration tests
+    dispTestName("Ascending insert", u);
+    ascendingInsert<cs540::UnrolledMap<int,int>>(1000000);
+    ascendingInsert<cs540::UnrolledMap<int,int>>(10000000);
+    dispTestName("Descending insert", u);
+    descendingInsert<cs540::UnrolledMap<int,int>>(1000000);
+    descendingInsert<cs540::UnrolledMap<int,int>>(10000000);
+    dispTestName("Delete test", u);
+    deleteTest<cs540::UnrolledMap<int,int>>();
+    dispTestName("Find test", u);
+    findTest<cs540::UnrolledMap<int,int>>();
+    dispTestName("Iteration test", u);
+    iterationTest<cs540::UnrolledMap<int,int>>(10000);
+    iterationTest<cs540::UnrolledMap<int,int>>(160000);
+    iterationTest<cs540::UnrolledMap<int,int>>(5120000);
+  }
+  
   {
     //Test copy constructor scaling
     dispTestName("Copy test", m);
@@ -613,10 +975,78 @@ int main() {
     copyTest<cs540::StdMapWrapper<int,int>>(1000000);
     copyTest<cs540::StdMapWrapper<int,int>>(10000000);
   }
+
+  {
+    dispTestName("Snapshot test", m);
+    snapshotTest<cs540::Map<int,int>>(100000);
+    snapshotTest<cs540::Map<int,int>>(1000000);
+    snapshotTest<cs540::Map<int,int>>(10000000);
+  }
+
+  {
+    dispTestName("Persistent reopen test", p);
+    persistentReopenTest(100000);
+    persistentReopenTest(1000000);
+    persistentReopenTest(10000000);
+  }
+
+  {
+    dispTestName("Read only find test", m);
+    for(int count : {1000, 100000, 10000000}) {
+      auto map = ascendingInsert<cs540::Map<int,int>>(count, false);
+      readOnlyFindTest(map, 1000000);
+    }
+    dispTestName("Read only find test", f);
+    for(int count : {1000, 100000, 10000000}) {
+      cs540::FrozenMap<int,int> map(ascendingInsert<cs540::Map<int,int>>(count, false));
+      readOnlyFindTest(map, 1000000);
+    }
+  }
+
+  {
+    dispTestName("Small maps test", m);
+    smallMapsTest<cs540::Map<int,int>>(1000000, 0);
+    smallMapsTest<cs540::Map<int,int>>(1000000, 4);
+    smallMapsTest<cs540::Map<int,int>>(1000000, 39);
+    smallMapsTest<cs540::Map<int,int>>(100000, 64);
+    dispTestName("Small maps test", w);
+    smallMapsTest<cs540::StdMapWrapper<int,int>>(1000000, 0);
+    smallMapsTest<cs540::StdMapWrapper<int,int>>(1000000, 4);
+    smallMapsTest<cs540::StdMapWrapper<int,int>>(1000000, 39);
+    smallMapsTest<cs540::StdMapWrapper<int,int>>(100000, 64);
+  }
+  
+  {
+    //Test copy assignment scaling
+    dispTestName("Copy assignment test", m);
+    copyAssignTest<cs540::Map<int,int>>(10000);
+    copyAssignTest<cs540::Map<int,int>>(100000);
+    copyAssignTest<cs540::Map<int,int>>(1000000);
+    copyAssignTest<cs540::Map<int,int>>(10000000);
+    dispTestName("Copy assignment test", w);
+    copyAssignTest<cs540::StdMapWrapper<int,int>>(10000);
+    copyAssignTest<cs540::StdMapWrapper<int,int>>(100000);
+    copyAssignTest<cs540::StdMapWrapper<int,int>>(1000000);
+    copyAssignTest<cs540::StdMapWrapper<int,int>>(10000000);
+  }
+  
+  {
+    //Test indexibility scaling
+    dispTestName("Index test", m);
+    indexTest<cs540::Map<int,int>>(10000);
+    indexTest<cs540::Map<int,int>>(100000);
+    indexTest<cs540::Map<int,int>>(1000000);
+    indexTest<cs540::Map<int,int>>(10000000);
+    //std::map has to walk to each position, so keep it to sizes that finish
+    dispTestName("Index test", w);
+    indexTest<cs540::StdMapWrapper<int,int>>(10000);
+    indexTest<cs540::StdMapWrapper<int,int>>(100000);
+    indexTest<cs540::StdMapWrapper<int,int>>(1000000);
+  }
   
-  //Add your own indexibility scaling test here
- 
   // Cast, due to const-ness.
   free((void *) w);
   free((void *) m);
+  free((void *) f);
+  free((void *) p);
 }
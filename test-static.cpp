@@ -0,0 +1,93 @@
+#include "StaticMap.hpp"
+
+#include <iostream>
+#include <string_view>
+#include <stdexcept>
+#include <functional>
+#include <map>
+#include <cassert>
+
+using namespace std::literals;
+
+constexpr auto primes = cs540::make_static_map<int, int>({
+    {13, 6}, {2, 1}, {29, 10}, {7, 4}, {23, 9}, {3, 2}, {31, 11},
+    {19, 8}, {5, 3}, {11, 5}, {37, 12}, {17, 7}, {41, 13},
+});
+
+// everything here is decided by the compiler
+static_assert(primes.size() == 13 && !primes.empty());
+static_assert(primes.at(2) == 1 && primes.at(41) == 13 && primes.at(17) == 7);
+static_assert(primes.contains(31) && !primes.contains(30) && primes.count(1) == 0);
+static_assert(primes.begin()->first == 2 && (*--primes.end()).first == 41);
+static_assert(primes.lower_bound(30)->first == 31 && primes.upper_bound(31)->first == 37);
+static_assert(primes.lower_bound(42) == primes.end() && primes.find(4) == primes.end());
+
+// any comparator that can run in a constant expression
+constexpr auto reversed = cs540::make_static_map<std::string_view, int>({
+    {"pear"sv, 3}, {"apple"sv, 1}, {"quince"sv, 4}, {"fig"sv, 2},
+}, std::greater<std::string_view>());
+
+static_assert(reversed.begin()->first == "quince" && reversed.at("fig") == 2);
+
+void against_std_map() {
+    std::map<int, int> s;
+    for (auto e : primes) {
+        s.insert({e.first, e.second});
+    }
+    assert(s.size() == primes.size());
+
+    auto it = primes.begin();
+    for (auto &e : s) {
+        assert(it->first == e.first && it->second == e.second);
+        it++;
+    }
+    assert(it == primes.end());
+
+    for (int k = -1; k < 45; k++) {
+        assert(primes.count(k) == s.count(k));
+        auto lb = primes.lower_bound(k);
+        auto slb = s.lower_bound(k);
+        assert((lb == primes.end()) == (slb == s.end()));
+        if (slb != s.end()) assert(lb->first == slb->first);
+        auto ub = primes.upper_bound(k);
+        auto sub = s.upper_bound(k);
+        assert((ub == primes.end()) == (sub == s.end()));
+        if (sub != s.end()) assert(ub->first == sub->first);
+    }
+}
+
+void runtime_keys() {
+    // a key only known at run time is still looked up, and a missing one throws
+    volatile int input = 23;
+    int probe = input;
+    assert(primes.at(probe) == 9);
+
+    bool thrown = false;
+    try {
+        primes.at(probe + 1);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // a duplicate key is only an error at run time when the map is not constexpr
+    thrown = false;
+    try {
+        auto dup = cs540::make_static_map<int, int>({{1, 1}, {2, 2}, {1, 3}});
+        (void)dup;
+    } catch (std::invalid_argument &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    auto one = cs540::make_static_map<char, std::string_view>({{'x', "only"sv}});
+    assert(one.size() == 1 && one.at('x') == "only" && one.find('y') == one.end());
+}
+
+int main () {
+    against_std_map();
+    runtime_keys();
+
+    std::cout << "StaticMap tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "UnrolledMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <random>
+#include <map>
+#include <type_traits>
+#include <cassert>
+
+// random inserts and erases checked against std::map, enough to split,
+// merge and borrow across many blocks
+template <typename K, typename F>
+void against_std_map(F makeKey, int range, int ops) {
+    std::default_random_engine gen(7);
+    cs540::UnrolledMap<K, int> m;
+    std::map<K, int> s;
+
+    for (int i = 0; i < ops; ++i) {
+        K k = makeKey(gen() % range);
+        switch (gen() % 4) {
+            case 0:
+            case 1:
+                assert(m.insert({k, i}).second == s.insert({k, i}).second);
+                break;
+            case 2:
+                if (s.erase(k)) m.erase(k);
+                break;
+            default:
+                auto it = m.find(k);
+                assert((it == m.end()) == !s.count(k));
+                auto lb = m.lower_bound(k);
+                auto slb = s.lower_bound(k);
+                assert((lb == m.end()) == (slb == s.end()));
+                if (slb != s.end()) assert(lb->first == slb->first && lb->second == slb->second);
+        }
+    }
+
+    assert(m.size() == s.size());
+    auto it = m.begin();
+    for (auto &e : s) {
+        assert(it->first == e.first && it->second == e.second);
+        ++it;
+    }
+    assert(it == m.end());
+}
+
+void access_and_iteration() {
+    cs540::UnrolledMap<int, long> m{{3, 3}, {1, 1}, {2, 2}};
+    for (int i = 100; i < 1000; ++i) {
+        m[i] = i;
+    }
+    assert(m.size() == 903 && m.at(500) == 500);
+
+    bool thrown = false;
+    try {
+        m.at(10000);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // backwards from end visits every element
+    size_t count = 0;
+    auto it = m.end();
+    while (it != m.begin()) {
+        --it;
+        ++count;
+    }
+    assert(count == m.size() && it->first == 1);
+
+    const auto copy = m;
+    assert(copy.size() == m.size() && copy.at(999) == 999 && copy.find(50) == copy.end());
+
+    for (int i = 100; i < 1000; i += 2) {
+        m.erase(i);
+    }
+    m.erase(m.find(1));
+    assert(m.size() == 452 && m.begin()->first == 2 && copy.size() == 903);
+}
+
+// moves hand over the blocks without allocating, and leave an empty map
+// that allocates again only when something is inserted into it
+void moves() {
+    typedef cs540::UnrolledMap<int, int> M;
+    static_assert(std::is_nothrow_move_constructible<M>::value && std::is_nothrow_move_assignable<M>::value,
+                  "moves do not allocate");
+    M a;
+    assert(a.begin() == a.end() && a.find(1) == a.end() && a.lower_bound(1) == a.end());
+    for (int i = 0; i < 100; ++i) {
+        a[i] = i;
+    }
+    M b(std::move(a));
+    assert(b.size() == 100 && a.empty() && a.begin() == a.end() && a.find(5) == a.end());
+    a.clear();
+    a.insert({7, 7});
+    M c;
+    c = std::move(b);
+    b = std::move(a);
+    swap(a, c);
+    assert(a.size() == 100 && a.at(99) == 99 && b.size() == 1 && b.at(7) == 7 && c.empty());
+    M d(c);
+    assert(d.empty() && d.begin() == d.end());
+}
+
+int main () {
+    access_and_iteration();
+    moves();
+    against_std_map<int>([](int x) { return x - 1000; }, 5000, 200000);
+    against_std_map<long>([](int x) { return long(x) * 1000003; }, 5000, 200000);
+    against_std_map<std::string>([](int x) { return std::to_string(x); }, 5000, 200000);
+
+    std::cout << "UnrolledMap tests passed" << std::endl;
+    return 0;
+}
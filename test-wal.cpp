@@ -0,0 +1,205 @@
+#include "LoggedMap.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <random>
+#include <map>
+#include <cstdio>
+#include <cassert>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PATH "test-wal.log"
+
+template <typename M>
+void check(const M &m, const std::map<int, std::string> &s) {
+    assert(m.size() == s.size());
+    auto it = m.begin();
+    for (auto &e : s) {
+        assert(it != m.end() && it->first == e.first && it->second == e.second);
+        ++it;
+    }
+    assert(it == m.end());
+}
+
+void remove_all() {
+    std::remove(PATH);
+    std::remove(PATH ".snapshot");
+}
+
+// random changes under every sync policy, checked against std::map each
+// time the log is reopened, with a checkpoint partway through
+void against_std_map(int ops) {
+    std::default_random_engine gen(7);
+    std::map<int, std::string> s;
+    cs540::wal_sync policies[] = {cs540::wal_sync::none, cs540::wal_sync::group, cs540::wal_sync::always};
+    for (int round = 0; round < 3; round++) {
+        cs540::LoggedMap<int, std::string> m(PATH, policies[round]);
+        check(m.map(), s);
+        int n = round == 2 ? ops / 20 : ops;
+        for (int i = 0; i < n; i++) {
+            int k = gen() % 5000;
+            switch (gen() % 4) {
+                case 0: {
+                    std::string v = std::to_string(i);
+                    assert(m.insert({k, v}).second == s.insert({k, v}).second);
+                    break;
+                }
+                case 1: {
+                    std::string v = std::string(i % 13, 'v');
+                    m.insert_or_assign(k, v);
+                    s[k] = v;
+                    break;
+                }
+                default:
+                    if (s.erase(k)) m.erase(k);
+            }
+            if (round == 1 && i == n / 2) m.checkpoint();
+        }
+        check(m.map(), s);
+    }
+    check(cs540::recover<int, std::string>(PATH), s);
+}
+
+// a process that dies without committing loses its pending batch, changes
+// that had already returned included, and a batch cut short on disk is
+// dropped and overwritten
+void crashes() {
+    remove_all();
+    pid_t pid = fork();
+    if (pid == 0) {
+        cs540::LoggedMap<int, std::string> m(PATH);
+        for (int i = 0; i < 100; i++) {
+            m.insert_or_assign(i, std::to_string(i));
+        }
+        m.commit();
+        m.insert_or_assign(1000, "lost");
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status));
+
+    std::map<int, std::string> s;
+    for (int i = 0; i < 100; i++) {
+        s[i] = std::to_string(i);
+    }
+    check(cs540::recover<int, std::string>(PATH), s);
+
+    {
+        cs540::LoggedMap<int, std::string> m(PATH);
+        m.erase(5);
+        m.commit();
+    }
+    s.erase(5);
+
+    // tear off the end of the last batch
+    struct stat st;
+    stat(PATH, &st);
+    assert(truncate(PATH, st.st_size - 3) == 0);
+    s[5] = "5";
+    check(cs540::recover<int, std::string>(PATH), s);
+
+    {
+        cs540::LoggedMap<int, std::string> m(PATH);
+        check(m.map(), s);
+        m.insert_or_assign(7, "seven");
+    }
+    s[7] = "seven";
+    check(cs540::recover<int, std::string>(PATH), s);
+
+    // erasing a missing key throws and logs nothing
+    {
+        cs540::LoggedMap<int, std::string> m(PATH);
+        bool thrown = false;
+        try {
+            m.erase(-1);
+        } catch (std::out_of_range &) {
+            thrown = true;
+        }
+        assert(thrown);
+        m.clear();
+    }
+    check(cs540::recover<int, std::string>(PATH), {});
+
+    // a crash inside clear() after the empty snapshot is saved but before
+    // the log is emptied: the logged clear keeps the old puts from coming back
+    {
+        cs540::LoggedMap<int, std::string> m(PATH);
+        for (int i = 0; i < 10; i++) {
+            m.insert_or_assign(i, "back");
+        }
+    }
+    {
+        typedef cs540::WriteAheadLog<int, std::string> Log;
+        Log log(PATH, Log::replay(PATH, [](uint8_t, const int *, std::string &&) {}), cs540::wal_sync::group);
+        log.clear();
+        log.commit();
+    }
+    cs540::Map<int, std::string>().save(PATH ".snapshot");
+    check(cs540::recover<int, std::string>(PATH), {});
+
+    // a log of other types is refused
+    bool thrown = false;
+    try {
+        cs540::recover<int, int>(PATH);
+    } catch (std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+// a change whose record cannot be written is neither made nor left half
+// written in the log, so the changes after it still replay
+void failed_writes() {
+    remove_all();
+    pid_t pid = fork();
+    if (pid == 0) {
+        cs540::LoggedMap<int, std::string> m(PATH, cs540::wal_sync::always);
+        m.insert_or_assign(1, "one");
+        struct stat st;
+        stat(PATH, &st);
+        struct rlimit old, lim;
+        getrlimit(RLIMIT_FSIZE, &old);
+        lim = old;
+        lim.rlim_cur = st.st_size + 64;
+        std::signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &lim);
+
+        int thrown = 0;
+        try {
+            m.insert_or_assign(2, std::string(1000, 'x'));
+        } catch (std::system_error &) {
+            thrown++;
+        }
+        try {
+            m.insert({3, std::string(1000, 'x')});
+        } catch (std::system_error &) {
+            thrown++;
+        }
+        bool unchanged = thrown == 2 && m.map().size() == 1;
+        setrlimit(RLIMIT_FSIZE, &old);
+        m.insert_or_assign(4, "four");
+        _exit(unchanged ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    check(cs540::recover<int, std::string>(PATH), {{1, "one"}, {4, "four"}});
+}
+
+int main () {
+    remove_all();
+    against_std_map(100000);
+    crashes();
+    failed_writes();
+    remove_all();
+
+    std::cout << "LoggedMap tests passed" << std::endl;
+    return 0;
+}
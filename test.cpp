@@ -2,12 +2,22 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <utility>
+#include <type_traits>
 #include <random>
 #include <chrono>
 #include <iterator>
 #include <cassert>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <map>
+#include <cstdio>
+
+// a value type with no snapshot codec only rules out save() and load()
+template class cs540::Map<int, std::vector<int>>;
 
 void stress(int stress_size) {
     auto seed = std::chrono::system_clock::now().time_since_epoch().count();
@@ -98,6 +108,397 @@ void count_words() {
     
 }
 
+void move_and_emplace() {
+    cs540::Map<std::string, std::unique_ptr<int>> m;
+
+    // move-only values can only get in by being moved or built in place
+    auto ret = m.emplace("one", std::unique_ptr<int>(new int(1)));
+    assert(ret.second);
+    ret = m.try_emplace("two", new int(2));
+    assert(ret.second && *ret.first->second == 2);
+
+    // try_emplace leaves its arguments alone when the key exists
+    std::unique_ptr<int> three(new int(3));
+    ret = m.try_emplace("two", std::move(three));
+    assert(!ret.second && three && *m.at("two") == 2);
+    m.insert({"three", std::move(three)});
+    assert(!three && *m.at("three") == 3);
+
+    cs540::Map<std::string, std::unique_ptr<int>> moved(std::move(m));
+    assert(moved.size() == 3 && m.empty());
+
+    cs540::Map<std::string, std::unique_ptr<int>> other;
+    other["four"].reset(new int(4));
+    other = std::move(moved);
+    assert(other.size() == 3 && other.find("four") == other.end());
+
+    swap(other, m);
+    assert(m.size() == 3 && other.empty());
+    assert(*m.at("one") == 1);
+}
+
+void positional_access() {
+    cs540::Map<int, int> m;
+    for (int i = 0; i < 100; ++i) {
+        m.insert({i * 10, i});
+    }
+    m.erase(500);
+
+    assert(m.nth(0)->first == 0);
+    assert(m.nth(50)->first == 510); // 500 is gone, so everything after shifted down
+    assert(m.nth(m.size()) == m.end());
+    assert(m.rank(510) == 50);
+    assert(m.rank(505) == 50); // keys that are not present rank where they would go
+    assert(m.count_range(100, 200) == 10);
+    assert(m.count_range(200, 100) == 0);
+
+    const auto copy = m;
+    assert(copy.nth(98)->first == 990);
+    assert(copy.rank(990) == 98);
+}
+
+void bounds_and_ranges() {
+    cs540::Map<int, int> m;
+    for (int i = 0; i < 100; ++i) {
+        m.insert({i * 10, i});
+    }
+
+    assert(m.lower_bound(20)->first == 20);
+    assert(m.lower_bound(21)->first == 30);
+    assert(m.upper_bound(20)->first == 30);
+    assert(m.upper_bound(990) == m.end());
+    auto range = m.equal_range(25);
+    assert(range.first == range.second);
+
+    // drops 100, 110, ..., 190
+    assert(m.erase_range(100, 200) == 10);
+    assert(m.size() == 90 && m.find(150) == m.end());
+    assert(m.lower_bound(100)->first == 200);
+
+    m.erase(m.lower_bound(900), m.end());
+    assert(m.size() == 80 && (--m.end())->first == 890);
+    assert(m.nth(79)->first == 890);
+}
+
+void hinted_insert() {
+    cs540::Map<int, int> m;
+    for (int i = 0; i < 1000; ++i) {
+        m.insert(m.end(), {i, i});
+    }
+    auto hint = m.end();
+    for (int i = 2000; i > 1000; --i) {
+        hint = m.emplace_hint(hint, i, i);
+    }
+    // a hint that is no help still inserts in the right place
+    m.insert(m.begin(), {1500, -1});
+    m.insert(m.begin(), {-1, -1});
+
+    assert(m.size() == 2001);
+    assert(m.at(1500) == 1500);
+    int expected = -1;
+    for (auto &e : m) {
+        assert(e.first == expected);
+        expected += (expected == 999) ? 2 : 1;
+    }
+    assert(m.nth(1001)->first == 1001 && m.rank(2000) == 2000);
+}
+
+void bulk_load() {
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 0; i < 1000; ++i) {
+        sorted.push_back({i, -i});
+    }
+
+    cs540::Map<int, int> m(cs540::sorted_unique, sorted.begin(), sorted.end());
+    assert(m.size() == 1000 && m.at(999) == -999 && m.nth(500)->first == 500);
+
+    // unsorted input is still accepted, only the sorted prefix is a straight append
+    sorted.push_back({-5, 5});
+    sorted.push_back({10, 10});
+    m.assign_sorted(sorted.begin(), sorted.end());
+    assert(m.size() == 1001 && m.begin()->first == -5 && m.at(10) == -10);
+    m.insert({2000, 0});
+    m.erase(500);
+    assert(m.rank(2000) == 1000);
+}
+
+void batch_lookup() {
+    cs540::Map<int, int> m;
+    for (int i = 0; i < 1000; i += 2) {
+        m.insert({i, i * 10});
+    }
+
+    // sorted probes, with misses and a repeat
+    std::vector<int> sorted{-1, 0, 0, 3, 500, 998, 999, 5000};
+    std::vector<cs540::Map<int, int>::Iterator> found;
+    m.find_batch(sorted.begin(), sorted.end(), std::back_inserter(found));
+    assert(found.size() == sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        assert(found[i] == m.find(sorted[i]));
+    }
+
+    // unsorted probes come back in the order given
+    const auto &m_ref = m;
+    std::vector<int> shuffled{998, 3, 0, 5000, 500, -1, 0};
+    std::vector<cs540::Map<int, int>::ConstIterator> cfound;
+    m_ref.find_batch(shuffled.begin(), shuffled.end(), std::back_inserter(cfound));
+    assert(cfound.size() == shuffled.size());
+    assert(cfound[0]->second == 9980 && cfound[1] == m.end() && cfound[4]->first == 500);
+
+    // interleaved lookups, more keys than searches run side by side
+    std::vector<int> many;
+    for (int i = 0; i < 100; ++i) {
+        many.push_back((i * 37) % 1010);
+    }
+    found.clear();
+    m.find_many(many.begin(), many.end(), std::back_inserter(found));
+    assert(found.size() == many.size());
+    for (size_t i = 0; i < many.size(); ++i) {
+        assert(found[i] == m.find(many[i]));
+    }
+}
+
+void custom_order() {
+    cs540::Map<int, int, std::greater<int>> m;
+    for (int i = 0; i < 100; ++i) {
+        m.insert({i, i});
+    }
+    assert(m.begin()->first == 99 && m.nth(99)->first == 0);
+    assert(m.lower_bound(50)->first == 50 && m.upper_bound(50)->first == 49);
+    assert(m.rank(90) == 9 && m.count_range(60, 40) == 20);
+    m.erase(50);
+    assert(m.find(50) == m.end() && m.size() == 99);
+
+    cs540::Map<int, int, std::greater<int>> copy(m);
+    assert(copy == m && copy.key_comp()(2, 1));
+}
+
+void transparent_lookup() {
+    cs540::Map<std::string, int, std::less<>> m{{"alpha", 1}, {"beta", 2}, {"gamma", 3}};
+    const char buffer[] = "GET /beta HTTP/1.1";
+    std::string_view slice(buffer + 5, 4);
+
+    assert(m.find(slice)->second == 2 && m.at("gamma") == 3);
+    assert(m.count(slice) == 1 && !m.contains("delta") && m.contains(std::string("alpha")));
+    assert(m.lower_bound("b")->first == "beta" && m.upper_bound(slice)->first == "gamma");
+    assert(m.equal_range("alpha").second == m.find("beta"));
+
+    const auto &m_ref = m;
+    assert(m_ref.at(slice) == 2 && m_ref.find("zeta") == m_ref.end());
+
+    m.erase(slice);
+    bool thrown = false;
+    try {
+        m.erase("beta");
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown && m.size() == 2);
+    m.erase(m.begin());
+    assert(m.size() == 1 && m.begin()->first == "gamma");
+}
+
+// keys that tie on or straddle the cached 8 byte prefix
+void string_prefixes() {
+    std::vector<std::string> keys{"", "a", std::string("a\0", 2), "a\x01", "abcdefgh", "abcdefgh0",
+                                  "abcdefgh1", "abcdefgi", "\x7f", "\x80", "\xff\xff"};
+    cs540::Map<std::string, size_t> m;
+    for (size_t i = keys.size(); i-- > 0;) {
+        m.insert({keys[i], i});
+    }
+
+    size_t i = 0;
+    for (auto &e : m) {
+        assert(e.first == keys[i] && e.second == i);
+        ++i;
+    }
+    assert(m.find(std::string("a\0", 2))->second == 2 && m.find("abcdefgh2") == m.end());
+    assert(m.lower_bound("abcdefgh00")->first == "abcdefgh1");
+}
+
+// counts what the map asks its allocator for
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+    size_t *count;
+    size_t *bytes;
+
+    explicit CountingAllocator(size_t *c, size_t *b = NULL) : count(c), bytes(b) {}
+    template <typename U> CountingAllocator(const CountingAllocator<U> &o) : count(o.count), bytes(o.bytes) {}
+
+    T *allocate(size_t n) {
+        ++*count;
+        if (bytes) *bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+    template <typename U> bool operator==(const CountingAllocator<U> &o) const { return count == o.count; }
+    template <typename U> bool operator!=(const CountingAllocator<U> &o) const { return count != o.count; }
+};
+
+void empty_maps() {
+    typedef CountingAllocator<std::pair<const int, int>> Alloc;
+    size_t allocations = 0, bytes = 0;
+    {
+        cs540::Map<int, int, std::less<int>, Alloc> m{Alloc(&allocations, &bytes)};
+        const auto &m_ref = m;
+        assert(m.begin() == m.end() && m_ref.find(1) == m_ref.end() && m.nth(0) == m.end());
+        assert(m.lower_bound(1) == m.end() && m.rank(1) == 0 && m.erase_range(0, 10) == 0);
+
+        static_assert(std::is_nothrow_move_constructible<decltype(m)>::value
+                && std::is_nothrow_move_assignable<decltype(m)>::value
+                && noexcept(swap(m, m)), "moves and swaps never throw");
+        cs540::Map<int, int, std::less<int>, Alloc> copy(m), moved(std::move(copy));
+        copy = moved;
+        m.clear();
+        m.swap(moved);
+        assert(allocations == 0);
+
+        // one element takes the first slab and the smallest index, both
+        // sized for a handful of elements
+        m.insert({1, 1});
+        assert(allocations == 2 && bytes <= 512 && m.begin()->first == 1 && moved.empty());
+        for (int i = 2; i < 1000; ++i) {
+            m.insert({i, i});
+        }
+        assert(allocations > 2 && m.nth(500)->first == 501);
+    }
+
+    // the same seed builds the same towers
+    cs540::Map<int, int> a, b;
+    a.seed(42);
+    b.seed(42);
+    for (int i = 0; i < 1000; ++i) {
+        a.insert({i * 7 % 1000, i});
+        b.insert({i * 7 % 1000, i});
+    }
+    assert(a == b && a.nth(500)->first == 500);
+}
+
+// the same contents under every tower height policy, including a cap low
+// enough that most towers are cut short
+template <typename Levels>
+void level_policy() {
+    typedef cs540::Map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, Levels> LevelMap;
+    LevelMap m;
+    for (int i = 0; i < 5000; ++i) {
+        m.insert({i * 7919 % 5000, i});
+    }
+    for (int i = 0; i < 5000; i += 2) {
+        m.erase(i);
+    }
+    assert(m.size() == 2500 && m.nth(0)->first == 1 && m.rank(4999) == 2499);
+
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 0; i < 1000; ++i) {
+        sorted.push_back({i, i});
+    }
+    LevelMap loaded(cs540::sorted_unique, sorted.begin(), sorted.end());
+    m = loaded;
+    m.erase_range(0, 999);
+    assert(m.size() == 1 && m.begin()->first == 999 && loaded.nth(500)->first == 500);
+}
+
+// iterators taken while the map is small keep working as it grows past its
+// index and shrinks back, and follow their elements through swaps and moves
+void small_maps() {
+    cs540::Map<int, int> m;
+    std::vector<cs540::Map<int, int>::Iterator> its;
+    for (int i = 0; i < 20; ++i) {
+        its.push_back(m.insert({i * 2, i}).first);
+    }
+    assert(m.lower_bound(7)->first == 8 && m.upper_bound(8)->first == 10 && m.nth(3)->first == 6);
+
+    for (int i = 0; i < 10000; ++i) {
+        m.insert({i * 2 + 1, i});
+    }
+    for (int i = 0; i < 20; ++i) {
+        assert(its[i]->first == i * 2 && m.find(i * 2) == its[i]);
+    }
+
+    // leaves only what was inserted while small, which is small again
+    m.erase_range(40, 20000);
+    for (int i = 1; i < 40; i += 2) {
+        m.erase(i);
+    }
+    assert(m.size() == 20 && m.rank(10) == 5);
+    m.erase(its[5]);
+    assert(m.find(10) == m.end() && m.nth(5) == its[6]);
+
+    cs540::Map<int, int> other{{100, 100}, {-1, -1}};
+    for (int i = 0; i < 500; ++i) {
+        other.insert({i * 3, i});
+    }
+    cs540::Map<int, int> copy(m), otherCopy(other);
+    m.swap(other);
+    assert(m == otherCopy && other == copy && other.find(12) == its[6]);
+    cs540::Map<int, int> moved(std::move(other));
+    assert(moved == copy && other.empty() && ++moved.find(8) == its[6] && its[6]->first == 12);
+
+    auto it = moved.end();
+    while (it != moved.begin()) {
+        --it;
+    }
+    assert(it->first == 0);
+}
+
+void snapshots() {
+    const std::string path = "test-snapshot.bin";
+
+    // fixed size records
+    cs540::Map<int, double> m;
+    for (int i = 0; i < 5000; ++i) {
+        m.insert({i * 7 % 5003, i / 2.0});
+    }
+    m.save(path);
+    cs540::Map<int, double> loaded{{-1, -1}};
+    loaded.load(path);
+    assert(loaded == m && loaded.rank(700) == m.rank(700));
+    loaded.insert({-1, 0});
+    assert(loaded.size() == m.size() + 1 && loaded.begin()->first == -1);
+
+    // a file of other types, or a damaged one, leaves the map as it was
+    cs540::Map<std::string, std::string> s{{"kept", "yes"}};
+    bool thrown = false;
+    try {
+        s.load(path);
+    } catch (std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && s.size() == 1 && s.at("kept") == "yes");
+
+    // length prefixed strings, including empty ones
+    for (int i = 0; i < 300; ++i) {
+        s.insert({std::string(i % 40, 'a' + i % 26) + std::to_string(i), std::string(i % 3, 'v')});
+    }
+    s.save(path);
+    cs540::Map<std::string, std::string> t;
+    t.load(path);
+    assert(t == s && t.at("kept") == "yes" && t.at("0") == "");
+
+    std::FILE *f = std::fopen(path.c_str(), "r+b");
+    std::fseek(f, -1, SEEK_END);
+    std::fputc('!', f);
+    std::fseek(f, 0, SEEK_END);
+    std::fputc('!', f);
+    std::fclose(f);
+    thrown = false;
+    try {
+        t.load(path);
+    } catch (std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && t == s);
+
+    // empty maps round trip too
+    cs540::Map<std::string, std::string>().save(path);
+    t.load(path);
+    assert(t.empty() && t.begin() == t.end());
+
+    std::remove(path.c_str());
+}
+
 // creates a mapping from the values in the range [low, high) to their cubes
 cs540::Map<int, int> cubes(int low, int high) {
     cs540::Map<int, int> cb;
@@ -109,6 +510,80 @@ cs540::Map<int, int> cubes(int low, int high) {
 }
 
 
+template <typename M, typename S>
+void same_elements(M &m, const S &s) {
+    assert(m.size() == s.size());
+    size_t i = 0;
+    for (auto &e : s) {
+        auto it = m.nth(i++);
+        assert(it->first == e.first && it->second == e.second && m.rank(e.first) == i - 1);
+    }
+    auto it = m.end();
+    for (auto e = s.rbegin(); e != s.rend(); ++e) {
+        assert((--it)->first == e->first);
+    }
+    assert(it == m.begin());
+}
+
+void merging() {
+    std::default_random_engine gen(11);
+    std::map<int, int> sa, sb;
+    cs540::Map<int, int> a, b;
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 50000, v = gen();
+        if (sa.insert({k, v}).second) a.insert({k, v});
+        k = gen() % 50000;
+        if (sb.insert({k, v}).second) b.insert({k, v});
+    }
+
+    auto u = cs540::set_union(a, b);
+    auto n = cs540::set_intersection(a, b);
+    auto d = cs540::set_difference(a, b);
+    std::map<int, int> su(sa), sn, sd;
+    su.insert(sb.begin(), sb.end());
+    for (auto &e : sa) {
+        (sb.count(e.first) ? sn : sd).insert(e);
+    }
+    same_elements(u, su);
+    same_elements(n, sn);
+    same_elements(d, sd);
+    assert(cs540::set_union(a, cs540::Map<int, int>()) == a && cs540::set_intersection(cs540::Map<int, int>(), a).empty());
+
+    // nodes that move keep their addresses; duplicates stay behind
+    auto kept = b.find(sb.rbegin()->first);
+    bool moves = !sa.count(kept->first);
+    std::map<int, int> left;
+    for (auto &e : sb) {
+        if (sn.count(e.first)) left.insert(e);
+    }
+    a.merge(b);
+    same_elements(a, su);
+    same_elements(b, left);
+    if (moves) assert(a.find(kept->first) == kept);
+    a.insert({-5, 5});
+    b.insert({-5, 6});
+    a.erase(a.begin());
+    a.merge(b);
+    assert(a.at(-5) == 6 && b.size() == sn.size());
+
+    // keys that may throw on copy take the path that moves values instead
+    cs540::Map<std::string, int> x{{"b", 2}, {"d", 4}}, y{{"a", 1}, {"b", 20}, {"c", 3}};
+    for (int i = 0; i < 200; ++i) {
+        y.insert({"y" + std::to_string(i), i});
+    }
+    x.merge(std::move(y));
+    assert(x.size() == 204 && x.at("b") == 2 && x.at("y7") == 7 && y.size() == 1 && y.at("b") == 20);
+    assert(x.nth(2)->first == "c" && x.rank("y0") == 4);
+
+    // small maps give up their inline nodes
+    cs540::Map<int, int> small{{1, 1}, {3, 3}}, into{{2, 2}, {3, 30}};
+    into.merge(small);
+    assert(into.size() == 3 && into.at(3) == 30 && small.size() == 1 && small.at(3) == 3);
+    small.clear();
+    into.merge(small);
+    assert(into.size() == 3);
+}
+
 int main () {
     count_words();
 
@@ -134,6 +609,22 @@ int main () {
     assign_example = copy_example;
 
     access_by_key();
+    move_and_emplace();
+    positional_access();
+    bounds_and_ranges();
+    hinted_insert();
+    bulk_load();
+    batch_lookup();
+    custom_order();
+    transparent_lookup();
+    string_prefixes();
+    empty_maps();
+    small_maps();
+    snapshots();
+    merging();
+    level_policy<cs540::PromoteQuarter<>>();
+    level_policy<cs540::PromoteInverseE<>>();
+    level_policy<cs540::PromoteHalf<4>>();
     stress(10000);
 
     return 0;